@@ -8,6 +8,7 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/softirq.h"
 #include "threads/synch.h"
 
 /* The code in this file is an interface to an ATA (IDE)
@@ -70,7 +71,9 @@ struct channel
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
-    struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    struct semaphore completion_wait;   /* Up'd by completion softirq. */
+    struct softirq completion_sirq;     /* Raised by interrupt handler. */
+    unsigned completion_cnt;    /* Completions not yet up'd. */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
@@ -96,6 +99,7 @@ static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
+static softirq_func completion_softirq;
 
 /* Initialize the disk subsystem and detect disks. */
 void
@@ -123,9 +127,11 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      lock_init_named (&c->lock, c->name);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      softirq_init (&c->completion_sirq, completion_softirq, c);
+      c->completion_cnt = 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -514,7 +520,8 @@ interrupt_handler (struct intr_frame *f)
         if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
-            sema_up (&c->completion_wait);      /* Wake up waiter. */
+            c->completion_cnt++;
+            softirq_raise (&c->completion_sirq); /* Wake up waiter later. */
           }
         else
           printf ("%s: unexpected interrupt\n", c->name);
@@ -524,4 +531,20 @@ interrupt_handler (struct intr_frame *f)
   NOT_REACHED ();
 }
 
+/* Softirq for channel C_: wakes up the waiter once for each
+   interrupt taken since the last run. */
+static void
+completion_softirq (void *c_) 
+{
+  struct channel *c = c_;
+  enum intr_level old_level = intr_disable ();
+
+  while (c->completion_cnt > 0)
+    {
+      c->completion_cnt--;
+      sema_up (&c->completion_wait);
+    }
+  intr_set_level (old_level);
+}
+
 
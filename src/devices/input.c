@@ -2,15 +2,28 @@
 #include <debug.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/softirq.h"
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
 
+/* Keys received by interrupt handlers but not yet moved into
+   BUFFER.  Moving them, and waking up a reader, is left to
+   INPUT_SIRQ.  Accessed with interrupts off. */
+#define STAGE_SIZE 64
+static uint8_t stage[STAGE_SIZE];
+static unsigned stage_head, stage_tail;   /* Free-running indexes. */
+static struct softirq input_sirq;
+
+static void flush_stage (void);
+static softirq_func input_softirq;
+
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
   intq_init (&buffer);
+  softirq_init (&input_sirq, input_softirq, NULL);
 }
 
 /* Adds a key to the input buffer.
@@ -19,9 +32,10 @@ void
 input_putc (uint8_t key) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT (!intq_full (&buffer));
+  ASSERT (!input_full ());
 
-  intq_putc (&buffer, key);
+  stage[stage_head++ % STAGE_SIZE] = key;
+  softirq_raise (&input_sirq);
   serial_notify ();
 }
 
@@ -34,7 +48,9 @@ input_getc (void)
   uint8_t key;
 
   old_level = intr_disable ();
+  flush_stage ();
   key = intq_getc (&buffer);
+  flush_stage ();
   serial_notify ();
   intr_set_level (old_level);
   
@@ -48,5 +64,27 @@ bool
 input_full (void) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return intq_full (&buffer);
+  return stage_head - stage_tail >= STAGE_SIZE;
+}
+
+/* Moves as many staged keys into the input buffer as fit.
+   Interrupts must be off. */
+static void
+flush_stage (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (stage_tail != stage_head && !intq_full (&buffer))
+    intq_putc (&buffer, stage[stage_tail++ % STAGE_SIZE]);
+}
+
+/* Softirq that moves staged keys into the input buffer, waking
+   up any thread waiting for a key. */
+static void
+input_softirq (void *aux UNUSED) 
+{
+  enum intr_level old_level = intr_disable ();
+  flush_stage ();
+  serial_notify ();
+  intr_set_level (old_level);
 }
@@ -4,7 +4,14 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/fpu.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/schedtrace.h"
+#include "threads/slab.h"
+#include "threads/softirq.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
@@ -95,6 +102,7 @@ shutdown_power_off (void)
 #endif
 
   print_stats ();
+  schedtrace_dump ();
 
   printf ("Powering off...\n");
   serial_flush ();
@@ -120,7 +128,13 @@ static void
 print_stats (void)
 {
   timer_print_stats ();
+  intr_print_stats ();
+  softirq_print_stats ();
   thread_print_stats ();
+  fpu_print_stats ();
+  palloc_print_stats ();
+  slab_print_stats ();
+  synch_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -4,6 +4,7 @@
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
@@ -20,14 +21,87 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* List of threads blocked in timer_sleep(), ordered by
+   increasing wakeup_tick so that timer_interrupt() only has to
+   look at the front. */
+static struct list sleep_list;
+
+/* If false (default), the timer interrupts TIMER_FREQ times per
+   second even while idle.  If true, the periodic tick stops while
+   only the idle thread can run.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles in one timer tick. */
+#define PIT_TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Most ticks a single one-shot can cover, limited by the PIT's
+   16-bit counter.  At 100 Hz this is 5 ticks. */
+#define TICKLESS_MAX_TICKS (65536 / PIT_TICK_CYCLES)
+
+/* Number of ticks covered by the pending one-shot, or 0 if the
+   timer is in its normal periodic mode. */
+static int64_t tickless_ticks;
+
+/* Number of ticks that passed without a timer interrupt. */
+static int64_t skipped_ticks;
+
+/* List of threads blocked in a sub-tick precise sleep, ordered
+   by increasing wakeup_ns. */
+static struct list hr_sleep_list;
+
+/* While a thread in hr_sleep_list is due before the next tick,
+   channel 0 runs as a one-shot instead of periodically.  The
+   first one-shot ends at the sleeper's deadline (HR_DEADLINE),
+   and the last one ends where the interrupted tick would have
+   ended (HR_BOUNDARY), after which the periodic tick resumes in
+   its original phase. */
+enum hr_state
+  {
+    HR_NONE,                    /* Periodic mode. */
+    HR_DEADLINE,                /* One-shot ends at a sleeper's deadline. */
+    HR_BOUNDARY                 /* One-shot ends at a tick boundary. */
+  };
+static enum hr_state hr_state;
+
+/* In HR_DEADLINE state, PIT cycles between the end of the
+   pending one-shot and the next tick boundary. */
+static unsigned hr_boundary_cycles;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Time-stamp counter calibration, done by timer_calibrate().
+   tsc_hz is 0 if the CPU has no TSC or it is not calibrated yet,
+   in which case timer_ns() only has tick resolution.  Otherwise,
+   at TSC value tsc_base the time was ns_base, and tsc_mult is
+   the number of nanoseconds per TSC cycle as a 32.32 fixed-point
+   number. */
+static uint64_t tsc_hz;
+static uint64_t tsc_base;
+static int64_t ns_base;
+static uint64_t tsc_mult;
+
+/* Number of ticks to measure the TSC against. */
+#define TSC_CALIBRATE_TICKS 5
+
 static intr_handler_func timer_interrupt;
+static void wake_sleepers (void);
+static void skip_ticks (int64_t);
+static void calibrate_tsc (void);
+static int64_t tsc_to_ns (uint64_t cycles);
+static void hr_sleep_until (int64_t deadline);
+static void hr_wake_sleepers (void);
+static void hr_arm (unsigned boundary_cycles, bool periodic);
+static bool hr_wakeup_less (const struct list_elem *,
+                            const struct list_elem *, void *aux);
+static bool wakeup_less (const struct list_elem *,
+                         const struct list_elem *, void *aux);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static void precise_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
@@ -35,6 +109,8 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  list_init (&sleep_list);
+  list_init (&hr_sleep_list);
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -64,6 +140,42 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  calibrate_tsc ();
+}
+
+/* Measures the TSC frequency against TSC_CALIBRATE_TICKS timer
+   ticks, which enables nanosecond resolution in timer_ns() and
+   precise sub-tick sleeps. */
+static void
+calibrate_tsc (void)
+{
+  uint64_t start_tsc, end_tsc;
+  int64_t start;
+  enum intr_level old_level;
+
+  if (!cpu_has (CPUID_EDX_TSC))
+    return;
+
+  /* Wait for a timer tick, then count TSC cycles over the next
+     several ticks. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  start_tsc = rdtsc ();
+  start = ticks;
+  while (ticks < start + TSC_CALIBRATE_TICKS)
+    barrier ();
+  end_tsc = rdtsc ();
+
+  old_level = intr_disable ();
+  tsc_hz = (end_tsc - start_tsc) * TIMER_FREQ / TSC_CALIBRATE_TICKS;
+  tsc_mult = ((uint64_t) NSEC_PER_SEC << 32) / tsc_hz;
+  tsc_base = end_tsc;
+  ns_base = (start + TSC_CALIBRATE_TICKS) * (NSEC_PER_SEC / TIMER_FREQ);
+  intr_set_level (old_level);
+
+  printf ("Calibrating TSC...  %'"PRIu64" Hz.\n", tsc_hz);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -84,16 +196,39 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the number of nanoseconds since the OS booted.  Once
+   timer_calibrate() has run, this is read from the TSC and has
+   close to nanosecond resolution; before that, or without a TSC,
+   it advances one timer tick at a time. */
+int64_t
+timer_ns (void) 
+{
+  if (tsc_hz == 0)
+    return timer_ticks () * (NSEC_PER_SEC / TIMER_FREQ);
+  return ns_base + tsc_to_ns (rdtsc () - tsc_base);
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The thread is blocked on sleep_list until timer_interrupt()
+   notices that its wakeup tick has arrived, so it does not
+   occupy the run queue in the meantime. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = ticks + timer_ticks ();
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -105,19 +240,21 @@ timer_msleep (int64_t ms)
 }
 
 /* Sleeps for approximately US microseconds.  Interrupts must be
-   turned on. */
+   turned on.  With a calibrated TSC, blocks until the precise
+   deadline instead of rounding to timer ticks. */
 void
 timer_usleep (int64_t us) 
 {
-  real_time_sleep (us, 1000 * 1000);
+  precise_sleep (us, 1000 * 1000);
 }
 
 /* Sleeps for approximately NS nanoseconds.  Interrupts must be
-   turned on. */
+   turned on.  With a calibrated TSC, blocks until the precise
+   deadline instead of rounding to timer ticks. */
 void
 timer_nsleep (int64_t ns) 
 {
-  real_time_sleep (ns, 1000 * 1000 * 1000);
+  precise_sleep (ns, 1000 * 1000 * 1000);
 }
 
 /* Busy-waits for approximately MS milliseconds.  Interrupts need
@@ -159,21 +296,280 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  In tickless mode, replaces the periodic tick by
+   a one-shot interrupt at the earliest sleeper's wakeup tick, or
+   as far ahead as the PIT allows if nobody is asleep.
+
+   The MLFQS scheduler needs to see every second go by, so the
+   periodic tick is kept when it is in use.  It is also kept
+   while any thread is in a precise sub-tick sleep. */
+void
+timer_idle_enter (void)
+{
+  int64_t delta = TICKLESS_MAX_TICKS;
+  int64_t rt_deadline;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || thread_mlfqs || tickless_ticks != 0
+      || hr_state != HR_NONE || !list_empty (&hr_sleep_list))
+    return;
+
+  if (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick - ticks < delta)
+        delta = t->wakeup_tick - ticks;
+    }
+  rt_deadline = thread_rt_next_deadline ();
+  if (rt_deadline - ticks < delta)
+    delta = rt_deadline - ticks;
+  if (delta < 2)
+    return;
+
+  tickless_ticks = delta;
+  pit_configure_oneshot (0, delta * PIT_TICK_CYCLES);
+}
+
+/* Called by the scheduler, with interrupts off, whenever the
+   idle thread gives up the CPU.  If the CPU was woken by some
+   other interrupt before the one-shot ran out, reads back how far
+   the PIT got, catches `ticks' up by that many whole ticks and
+   restores the periodic tick. */
+void
+timer_idle_exit (void)
+{
+  unsigned remaining;
+  bool expired;
+  int64_t elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tickless_ticks == 0)
+    return;
+
+  remaining = pit_read_channel (0, &expired);
+  if (expired)
+    {
+      /* The one-shot interrupt is already pending and will
+         account for the last tick itself. */
+      elapsed = tickless_ticks - 1;
+    }
+  else
+    elapsed = (tickless_ticks * PIT_TICK_CYCLES - remaining) / PIT_TICK_CYCLES;
+
+  tickless_ticks = 0;
+  pit_configure_channel (0, 2, TIMER_FREQ);
+  skip_ticks (elapsed);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" ticks", timer_ticks ());
+  if (timer_tickless)
+    printf (", %"PRId64" skipped while idle", skipped_ticks);
+  printf ("\n");
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  if (hr_state == HR_DEADLINE)
+    {
+      /* A precise sleeper is due.  This is not a tick. */
+      hr_state = HR_NONE;
+      hr_wake_sleepers ();
+      hr_arm (hr_boundary_cycles, false);
+      thread_yield_to_higher ();
+      return;
+    }
+  else if (hr_state == HR_BOUNDARY)
+    {
+      /* Back at a tick boundary: resume the periodic tick. */
+      hr_state = HR_NONE;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+
+  if (tickless_ticks != 0)
+    {
+      /* A tickless one-shot ran out.  Go back to periodic mode
+         and account for the ticks it covered. */
+      int64_t elapsed = tickless_ticks - 1;
+      tickless_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      skip_ticks (elapsed);
+    }
+
   ticks++;
+  wake_sleepers ();
+  hr_wake_sleepers ();
+  hr_arm (PIT_TICK_CYCLES, true);
+  thread_yield_to_higher ();
+
   thread_tick ();
 }
 
+/* Wakes up every sleeper whose time has come. */
+static void
+wake_sleepers (void)
+{
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+    }
+}
+
+/* Converts CYCLES, a number of TSC cycles, to nanoseconds.
+   The 64x64-bit product with tsc_mult is split into 32-bit
+   pieces so that it does not overflow. */
+static int64_t
+tsc_to_ns (uint64_t cycles)
+{
+  uint32_t hi = cycles >> 32;
+  uint32_t lo = cycles;
+  uint32_t mult_hi = tsc_mult >> 32;
+  uint32_t mult_lo = tsc_mult;
+
+  return ((uint64_t) hi * mult_hi << 32) + (uint64_t) hi * mult_lo
+         + (uint64_t) lo * mult_hi + ((uint64_t) lo * mult_lo >> 32);
+}
+
+/* Blocks the running thread on hr_sleep_list until timer_ns()
+   reaches DEADLINE. */
+static void
+hr_sleep_until (int64_t deadline) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  unsigned count;
+  bool expired;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  old_level = intr_disable ();
+  if (timer_ns () < deadline)
+    {
+      cur->wakeup_ns = deadline;
+      list_insert_ordered (&hr_sleep_list, &cur->elem, hr_wakeup_less, NULL);
+
+      /* Our deadline may come before the next tick, or before
+         the pending one-shot.  If that one-shot has already
+         expired, its interrupt is pending and will re-arm. */
+      count = pit_read_channel (0, &expired);
+      if (hr_state == HR_NONE)
+        hr_arm (count, true);
+      else if (!expired && hr_state == HR_DEADLINE)
+        hr_arm (count + hr_boundary_cycles, false);
+      else if (!expired && hr_state == HR_BOUNDARY)
+        hr_arm (count, false);
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Wakes up every precise sleeper whose deadline has passed. */
+static void
+hr_wake_sleepers (void)
+{
+  int64_t now = timer_ns ();
+
+  while (!list_empty (&hr_sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&hr_sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_ns > now)
+        break;
+      list_pop_front (&hr_sleep_list);
+      thread_unblock (t);
+    }
+}
+
+/* Called when the next tick boundary is BOUNDARY_CYCLES PIT
+   cycles away.  PERIODIC says whether channel 0 is in its
+   periodic mode, as opposed to a one-shot that has run out or
+   is about to be replaced.  If the first precise sleeper is due
+   before the boundary, programs a one-shot for its deadline;
+   otherwise makes sure that the tick at the boundary happens. */
+static void
+hr_arm (unsigned boundary_cycles, bool periodic)
+{
+  int64_t delta, cycles;
+  struct thread *t;
+  bool deadline_first;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  deadline_first = false;
+  cycles = 0;
+  if (!list_empty (&hr_sleep_list))
+    {
+      t = list_entry (list_front (&hr_sleep_list), struct thread, elem);
+      delta = t->wakeup_ns - timer_ns ();
+      cycles = delta > 0 ? DIV_ROUND_UP (delta * PIT_HZ, NSEC_PER_SEC) : 1;
+      deadline_first = cycles < boundary_cycles;
+    }
+
+  if (deadline_first)
+    {
+      hr_state = HR_DEADLINE;
+      hr_boundary_cycles = boundary_cycles - cycles;
+      pit_configure_oneshot (0, cycles);
+    }
+  else if (!periodic)
+    {
+      /* Finish the current tick with a one-shot. */
+      hr_state = HR_BOUNDARY;
+      pit_configure_oneshot (0, boundary_cycles > 0 ? boundary_cycles : 1);
+    }
+}
+
+/* Returns true if thread A's precise deadline is before thread
+   B's. */
+static bool
+hr_wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+                void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_ns < b->wakeup_ns;
+}
+
+/* Advances `ticks' by N ticks that passed without a timer
+   interrupt while the CPU was idle. */
+static void
+skip_ticks (int64_t n)
+{
+  if (n <= 0)
+    return;
+  ticks += n;
+  skipped_ticks += n;
+  thread_skip_idle_ticks (n);
+  wake_sleepers ();
+}
+
+/* Returns true if thread A should wake up before thread B.
+   Threads with equal wakeup ticks keep their insertion order. */
+static bool
+wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
@@ -235,6 +631,21 @@ real_time_sleep (int64_t num, int32_t denom)
     }
 }
 
+/* Sleep for NUM/DENOM seconds, where DENOM divides
+   NSEC_PER_SEC.  Blocks until the exact deadline if the TSC is
+   calibrated, otherwise falls back to real_time_sleep(). */
+static void
+precise_sleep (int64_t num, int32_t denom) 
+{
+  ASSERT (intr_get_level () == INTR_ON);
+  ASSERT (NSEC_PER_SEC % denom == 0);
+
+  if (tsc_hz == 0)
+    real_time_sleep (num, denom);
+  else if (num > 0)
+    hr_sleep_until (timer_ns () + num * (NSEC_PER_SEC / denom));
+}
+
 /* Busy-wait for approximately NUM/DENOM seconds. */
 static void
 real_time_delay (int64_t num, int32_t denom)
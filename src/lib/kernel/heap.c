@@ -0,0 +1,174 @@
+/* Priority queue.
+
+   See heap.h for basic information. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes H as an empty heap that compares elements using
+   LESS, given auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) 
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->elem_cnt = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H.  Constant time. */
+void
+heap_push (struct heap *h, struct heap_elem *e) 
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = meld (h, h->root, e);
+  h->elem_cnt++;
+}
+
+/* Removes and returns the greatest element in H, which must not
+   be empty.  O(log n) amortized time. */
+struct heap_elem *
+heap_pop (struct heap *h) 
+{
+  struct heap_elem *max;
+
+  ASSERT (!heap_empty (h));
+
+  max = h->root;
+  h->root = merge_pairs (h, max->child);
+  h->elem_cnt--;
+  max->child = NULL;
+  return max;
+}
+
+/* Removes E, which must be in H, from H.  O(log n) amortized
+   time. */
+void
+heap_remove (struct heap *h, struct heap_elem *e) 
+{
+  ASSERT (!heap_empty (h));
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    {
+      heap_pop (h);
+      return;
+    }
+
+  /* Unlink E, together with its subtree, from its parent and
+     siblings, then meld its children back into the heap. */
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+
+  h->root = meld (h, h->root, merge_pairs (h, e->child));
+  h->elem_cnt--;
+  e->child = NULL;
+}
+
+/* Returns the greatest element in H, which must not be empty. */
+struct heap_elem *
+heap_max (const struct heap *h) 
+{
+  ASSERT (!heap_empty (h));
+
+  return h->root;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h) 
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+heap_empty (const struct heap *h) 
+{
+  return h->root == NULL;
+}
+
+/* Melds the heap-ordered trees rooted at A and B, either of
+   which may be null, by making the lesser root the first child
+   of the greater.  Returns the root of the result.  A and B must
+   not have siblings. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b) 
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (h->less (a, b, h->aux)) 
+    {
+      struct heap_elem *temp = a;
+      a = b;
+      b = temp;
+    }
+
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  return a;
+}
+
+/* Melds the list of sibling trees starting at FIRST into a
+   single tree and returns its root, or a null pointer if FIRST
+   is null.  Uses the standard two-pass scheme: meld adjacent
+   pairs from left to right, then meld the results from right to
+   left.  That is what gives the heap its logarithmic amortized
+   bound. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first) 
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* First pass.  PAIRS collects the melded pairs, linked
+     through `next', in reverse order. */
+  while (first != NULL) 
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+      struct heap_elem *pair;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        b->next = b->prev = NULL;
+
+      pair = meld (h, a, b);
+      pair->next = pairs;
+      pairs = pair;
+    }
+
+  /* Second pass. */
+  while (pairs != NULL) 
+    {
+      struct heap_elem *next = pairs->next;
+      pairs->next = NULL;
+      root = meld (h, root, pairs);
+      pairs = next;
+    }
+
+  if (root != NULL)
+    root->prev = NULL;
+  return root;
+}
@@ -0,0 +1,132 @@
+/* Test program for lib/kernel/heap.c.
+
+   Attempts to test the heap functionality that is not
+   sufficiently tested elsewhere in Pintos.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <heap.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a heap that we will test. */
+#define MAX_SIZE 64
+
+/* A heap element. */
+struct value
+  {
+    struct heap_elem elem;      /* Heap element. */
+    int value;                  /* Item value. */
+    bool removed;               /* Taken out by heap_remove()? */
+  };
+
+static void shuffle (struct value[], size_t);
+static bool value_less (const struct heap_elem *, const struct heap_elem *,
+                        void *);
+static void verify_heap (struct heap *, struct value[], int size);
+
+/* Test the heap implementation. */
+void
+test (void)
+{
+  int size;
+
+  printf ("testing various size heaps:");
+  for (size = 0; size < MAX_SIZE; size++)
+    {
+      int repeat;
+
+      printf (" %d", size);
+      for (repeat = 0; repeat < 10; repeat++)
+        {
+          static struct value values[MAX_SIZE];
+          struct heap heap;
+          int i;
+
+          /* Put values 0...SIZE in random order in VALUES. */
+          for (i = 0; i < size; i++)
+            {
+              values[i].value = i;
+              values[i].removed = false;
+            }
+          shuffle (values, size);
+
+          /* Assemble heap and verify that it pops in order. */
+          heap_init (&heap, value_less, NULL);
+          for (i = 0; i < size; i++)
+            heap_push (&heap, &values[i].elem);
+          ASSERT (heap_size (&heap) == (size_t) size);
+          verify_heap (&heap, values, size);
+
+          /* Reassemble heap, remove random elements, and verify
+             that the rest still pop in order. */
+          shuffle (values, size);
+          for (i = 0; i < size; i++)
+            heap_push (&heap, &values[i].elem);
+          for (i = 0; i < size; i++)
+            if (random_ulong () % 3 == 0)
+              {
+                heap_remove (&heap, &values[i].elem);
+                values[i].removed = true;
+              }
+          verify_heap (&heap, values, size);
+        }
+    }
+
+  printf (" done\n");
+  printf ("heap: PASS\n");
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (struct value *array, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      struct value t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = heap_entry (a_, struct value, elem);
+  const struct value *b = heap_entry (b_, struct value, elem);
+
+  return a->value < b->value;
+}
+
+/* Verifies that HEAP pops the values 0...SIZE in VALUES that
+   have not been removed, in decreasing order, and is then
+   empty. */
+static void
+verify_heap (struct heap *heap, struct value values[], int size)
+{
+  bool present[MAX_SIZE];
+  int i;
+
+  for (i = 0; i < size; i++)
+    present[values[i].value] = !values[i].removed;
+
+  for (i = size - 1; i >= 0; i--)
+    if (present[i])
+      {
+        struct value *v = heap_entry (heap_pop (heap), struct value, elem);
+        ASSERT (v->value == i);
+      }
+  ASSERT (heap_empty (heap));
+  ASSERT (heap_size (heap) == 0);
+}
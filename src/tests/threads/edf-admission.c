@@ -0,0 +1,51 @@
+/* Checks that the EDF real-time class admits threads only while
+   the total real-time utilization stays within RT_UTIL_MAX, and
+   that a real-time thread with a generous budget meets its
+   deadlines. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define PERIOD 20
+#define PERIOD_CNT 5
+
+static thread_func periodic_thread;
+
+void
+test_edf_admission (void) 
+{
+  struct semaphore done;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Admitting 50%%: %s.",
+       thread_set_realtime (PERIOD, PERIOD / 2) ? "yes" : "no");
+  sema_init (&done, 0);
+  thread_create ("periodic", PRI_DEFAULT, periodic_thread, &done);
+  sema_down (&done);
+  msg ("Raising own share to 95%%: %s.",
+       thread_set_realtime (PERIOD, PERIOD * 19 / 20) ? "yes" : "no");
+  thread_clear_realtime ();
+}
+
+static void
+periodic_thread (void *done_) 
+{
+  struct semaphore *done = done_;
+  int i;
+
+  msg ("Admitting another 50%%: %s.",
+       thread_set_realtime (PERIOD, PERIOD / 2) ? "yes" : "no");
+  msg ("Admitting 30%%: %s.",
+       thread_set_realtime (PERIOD, PERIOD * 3 / 10) ? "yes" : "no");
+  for (i = 0; i < PERIOD_CNT; i++)
+    thread_rt_wait_period ();
+  msg ("Missed %u deadlines in %d periods.",
+       thread_current ()->rt_misses, PERIOD_CNT);
+  thread_clear_realtime ();
+  sema_up (done);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-admission) begin
+(edf-admission) Admitting 50%: yes.
+(edf-admission) Admitting another 50%: no.
+(edf-admission) Admitting 30%: yes.
+(edf-admission) Missed 0 deadlines in 5 periods.
+(edf-admission) Raising own share to 95%: no.
+(edf-admission) end
+EOF
+pass;
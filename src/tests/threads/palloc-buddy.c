@@ -0,0 +1,70 @@
+/* Allocates and frees runs of pages of mixed sizes, checking
+   that no two runs overlap, and then checks that freeing them
+   all leaves memory unfragmented enough for a large run. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define RUN_CNT 32
+#define ROUND_CNT 10
+#define BIG_RUN 64
+
+/* Sizes of runs to allocate, in pages, used in rotation. */
+static const size_t sizes[] = {1, 3, 2, 5, 1, 7, 4, 2};
+#define SIZE_CNT (sizeof sizes / sizeof *sizes)
+
+static bool check_run (const uint8_t *, size_t page_cnt, uint8_t value);
+
+void
+test_palloc_buddy (void) 
+{
+  uint8_t *runs[RUN_CNT];
+  size_t cnts[RUN_CNT];
+  uint8_t *big;
+  int round, i;
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      for (i = 0; i < RUN_CNT; i++)
+        {
+          cnts[i] = sizes[(i + round) % SIZE_CNT];
+          runs[i] = palloc_get_multiple (PAL_ASSERT, cnts[i]);
+          memset (runs[i], i, cnts[i] * PGSIZE);
+        }
+      for (i = 0; i < RUN_CNT; i++)
+        if (!check_run (runs[i], cnts[i], i))
+          fail ("run %d of %zu pages overwritten in round %d",
+                i, cnts[i], round);
+
+      /* Free the odd runs first, to leave holes, then the rest. */
+      for (i = 1; i < RUN_CNT; i += 2)
+        palloc_free_multiple (runs[i], cnts[i]);
+      for (i = 0; i < RUN_CNT; i += 2)
+        palloc_free_multiple (runs[i], cnts[i]);
+    }
+  msg ("%d rounds of %d mixed-size runs done.", ROUND_CNT, RUN_CNT);
+
+  big = palloc_get_multiple (PAL_ZERO, BIG_RUN);
+  if (big == NULL)
+    fail ("could not allocate %d contiguous pages", BIG_RUN);
+  if (!check_run (big, BIG_RUN, 0))
+    fail ("%d-page run not zeroed", BIG_RUN);
+  palloc_free_multiple (big, BIG_RUN);
+  msg ("Allocated %d contiguous pages.", BIG_RUN);
+}
+
+/* Returns true if all PAGE_CNT pages at RUN are filled with
+   VALUE. */
+static bool
+check_run (const uint8_t *run, size_t page_cnt, uint8_t value) 
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt * PGSIZE; i++)
+    if (run[i] != value)
+      return false;
+  return true;
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-buddy) begin
+(palloc-buddy) 10 rounds of 32 mixed-size runs done.
+(palloc-buddy) Allocated 64 contiguous pages.
+(palloc-buddy) end
+EOF
+pass;
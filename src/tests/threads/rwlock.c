@@ -0,0 +1,69 @@
+/* Checks the readers-writer lock: readers share it, a waiting
+   writer keeps new readers out, and when the writer releases the
+   lock all the readers that queued up behind it are admitted
+   together. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static struct rwlock rwlock;
+
+static thread_func writer_thread;
+static thread_func reader_thread;
+
+void
+test_rwlock (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&rwlock);
+
+  /* Readers share the lock and keep writers out. */
+  rwlock_acquire_read (&rwlock);
+  msg ("Second read try-lock: %s.",
+       rwlock_try_acquire_read (&rwlock) ? "yes" : "no");
+  msg ("Write try-lock with readers: %s.",
+       rwlock_try_acquire_write (&rwlock) ? "yes" : "no");
+
+  /* A waiting writer keeps new readers out. */
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread, NULL);
+  msg ("Read try-lock with a writer waiting: %s.",
+       rwlock_try_acquire_read (&rwlock) ? "yes" : "no");
+  thread_create ("reader 1", PRI_DEFAULT + 1, reader_thread, NULL);
+  thread_create ("reader 2", PRI_DEFAULT + 1, reader_thread, NULL);
+  msg ("%llu readers blocked by writers.", rwlock_blocked_readers (&rwlock));
+
+  /* Releasing the last read lock hands the lock to the writer,
+     which runs, and then to both readers at once. */
+  msg ("Releasing read locks.");
+  rwlock_release_read (&rwlock);
+  rwlock_release_read (&rwlock);
+
+  msg ("Write try-lock after everyone left: %s.",
+       rwlock_try_acquire_write (&rwlock) ? "yes" : "no");
+  rwlock_release_write (&rwlock);
+}
+
+static void
+writer_thread (void *aux UNUSED) 
+{
+  rwlock_acquire_write (&rwlock);
+  msg ("Writer got the lock.");
+  rwlock_release_write (&rwlock);
+  msg ("Writer released the lock.");
+}
+
+static void
+reader_thread (void *aux UNUSED) 
+{
+  rwlock_acquire_read (&rwlock);
+  msg ("Reader got the lock with %u readers.", rwlock.readers);
+
+  /* Let the other reader in before we leave. */
+  thread_yield ();
+  rwlock_release_read (&rwlock);
+}
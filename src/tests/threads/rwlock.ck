@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock) begin
+(rwlock) Second read try-lock: yes.
+(rwlock) Write try-lock with readers: no.
+(rwlock) Read try-lock with a writer waiting: no.
+(rwlock) 2 readers blocked by writers.
+(rwlock) Releasing read locks.
+(rwlock) Writer got the lock.
+(rwlock) Writer released the lock.
+(rwlock) Reader got the lock with 2 readers.
+(rwlock) Reader got the lock with 2 readers.
+(rwlock) Write try-lock after everyone left: yes.
+(rwlock) end
+EOF
+pass;
@@ -0,0 +1,60 @@
+/* Allocates objects of an odd size from a slab cache with a
+   constructor, checking that each object is constructed and that
+   no two objects overlap, then frees them in a scrambled order
+   and allocates them again. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/slab.h"
+
+#define OBJ_CNT 200
+#define OBJ_SIZE 44
+#define ROUND_CNT 3
+
+static slab_ctor fill_ctor;
+
+void
+test_slab (void) 
+{
+  static struct slab_cache cache;
+  static uint8_t *objs[OBJ_CNT];
+  int round, i, j;
+
+  slab_cache_init (&cache, "test", OBJ_SIZE, fill_ctor);
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      for (i = 0; i < OBJ_CNT; i++)
+        {
+          objs[i] = slab_alloc (&cache);
+          if (objs[i] == NULL)
+            fail ("allocation %d failed in round %d", i, round);
+          for (j = 0; j < OBJ_SIZE; j++)
+            if (objs[i][j] != 0x5a)
+              fail ("object %d not constructed in round %d", i, round);
+        }
+      for (i = 0; i < OBJ_CNT; i++)
+        memset (objs[i], i, OBJ_SIZE);
+      for (i = 0; i < OBJ_CNT; i++)
+        for (j = 0; j < OBJ_SIZE; j++)
+          if (objs[i][j] != (uint8_t) i)
+            fail ("object %d overwritten in round %d", i, round);
+
+      /* Free every third object, then the rest. */
+      for (i = 0; i < OBJ_CNT; i += 3)
+        slab_free (&cache, objs[i]);
+      for (i = 0; i < OBJ_CNT; i++)
+        if (i % 3 != 0)
+          slab_free (&cache, objs[i]);
+    }
+  msg ("%d rounds of %d objects done.", ROUND_CNT, OBJ_CNT);
+  msg ("%zu objects in use, at most %zu.",
+       cache.used_cnt, cache.max_used_cnt);
+}
+
+/* Constructor that fills an object with a known pattern. */
+static void
+fill_ctor (void *obj) 
+{
+  memset (obj, 0x5a, OBJ_SIZE);
+}
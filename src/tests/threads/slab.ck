@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(slab) begin
+(slab) 3 rounds of 200 objects done.
+(slab) 0 objects in use, at most 200.
+(slab) end
+EOF
+pass;
@@ -29,6 +29,12 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"thread-create-bench", test_thread_create_bench},
+    {"workqueue", test_workqueue},
+    {"edf-admission", test_edf_admission},
+    {"palloc-buddy", test_palloc_buddy},
+    {"slab", test_slab},
+    {"rwlock", test_rwlock},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
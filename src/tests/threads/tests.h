@@ -23,6 +23,12 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_thread_create_bench;
+extern test_func test_workqueue;
+extern test_func test_edf_admission;
+extern test_func test_palloc_buddy;
+extern test_func test_slab;
+extern test_func test_rwlock;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
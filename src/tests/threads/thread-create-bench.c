@@ -0,0 +1,40 @@
+/* Creates and joins THREAD_CNT threads, one at a time, and
+   reports the average time taken per create/exit cycle.  Each
+   thread does nothing at all, so the figure is dominated by
+   thread creation and teardown, including the freeing of the
+   thread's page. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 10000
+
+static thread_func empty_thread;
+
+void
+test_thread_create_bench (void) 
+{
+  int64_t start, elapsed;
+  int i;
+
+  start = timer_ns ();
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      tid_t tid = thread_create ("bench", PRI_DEFAULT, empty_thread, NULL);
+      if (tid == TID_ERROR)
+        fail ("thread_create failed after %d threads", i);
+      thread_join (tid);
+    }
+  elapsed = timer_ns () - start;
+
+  msg ("%d threads created and joined.", THREAD_CNT);
+  msg ("%lld ns per create.", elapsed / THREAD_CNT);
+}
+
+static void
+empty_thread (void *aux UNUSED) 
+{
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+fail "missing thread count\n"
+  if !grep (/^\(thread-create-bench\) 10000 threads created and joined\.$/,
+	    @output);
+fail "missing timing\n"
+  if !grep (/^\(thread-create-bench\) \d+ ns per create\.$/, @output);
+pass;
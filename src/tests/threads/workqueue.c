@@ -0,0 +1,82 @@
+/* Checks that thread_join() waits for a thread to exit, then
+   runs a batch of work items through a small, bounded work
+   queue and checks that every item ran exactly once. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+#define WORKER_CNT 4
+#define CAPACITY 8
+#define WORK_CNT 64
+#define BATCH_CNT 16
+
+static thread_func sleeper;
+static work_func count_work;
+
+static int run_cnt[WORK_CNT];
+
+void
+test_workqueue (void) 
+{
+  static struct work works[WORK_CNT];
+  struct work *batch[BATCH_CNT];
+  struct workqueue wq;
+  bool done = false;
+  tid_t tid;
+  int i, j;
+
+  tid = thread_create ("sleeper", PRI_DEFAULT, sleeper, &done);
+  thread_join (tid);
+  msg ("Sleeper %s when joined.", done ? "done" : "NOT DONE");
+  thread_join (tid);
+  msg ("Joining an exited thread returned immediately.");
+
+  if (!workqueue_init (&wq, "worker", WORKER_CNT, PRI_DEFAULT, CAPACITY))
+    fail ("workqueue_init failed");
+  for (i = 0; i < WORK_CNT; i += BATCH_CNT)
+    {
+      for (j = 0; j < BATCH_CNT; j++)
+        {
+          work_init (&works[i + j], count_work, &run_cnt[i + j]);
+          batch[j] = &works[i + j];
+        }
+      workqueue_submit_batch (&wq, batch, BATCH_CNT);
+    }
+  workqueue_flush (&wq);
+  msg ("Queue flushed.");
+
+  for (i = 0; i < WORK_CNT; i++)
+    if (run_cnt[i] != 1)
+      fail ("work item %d ran %d times", i, run_cnt[i]);
+  msg ("Every work item ran once.");
+
+  workqueue_destroy (&wq);
+  msg ("Workers stopped.");
+}
+
+static void
+sleeper (void *done_) 
+{
+  bool *done = done_;
+
+  timer_msleep (100);
+  *done = true;
+}
+
+static void
+count_work (void *cnt_) 
+{
+  int *cnt = cnt_;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  ++*cnt;
+  intr_set_level (old_level);
+  thread_yield ();
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) Sleeper done when joined.
+(workqueue) Joining an exited thread returned immediately.
+(workqueue) Queue flushed.
+(workqueue) Every work item ran once.
+(workqueue) Workers stopped.
+(workqueue) end
+EOF
+pass;
@@ -0,0 +1,44 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Feature bits returned in EDX by CPUID leaf 1.
+   See [IA32-v2a] "CPUID". */
+#define CPUID_EDX_TSC (1u << 4)         /* Time-stamp counter. */
+
+/* Executes CPUID for the given LEAF and stores the resulting
+   registers into *EAX, *EBX, *ECX, and *EDX. */
+static inline void
+cpuid (uint32_t leaf, uint32_t *eax, uint32_t *ebx,
+       uint32_t *ecx, uint32_t *edx)
+{
+  /* See [IA32-v2a] "CPUID". */
+  asm volatile ("cpuid"
+                : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+                : "a" (leaf));
+}
+
+/* Returns true if the CPU has every feature in FEATURES, a set
+   of CPUID_EDX_* bits. */
+static inline bool
+cpu_has (uint32_t features)
+{
+  uint32_t eax, ebx, ecx, edx;
+  cpuid (1, &eax, &ebx, &ecx, &edx);
+  return (edx & features) == features;
+}
+
+/* Reads and returns the time-stamp counter, which counts CPU
+   clock cycles since reset. */
+static inline uint64_t
+rdtsc (void)
+{
+  /* See [IA32-v2b] "RDTSC". */
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* threads/cpu.h */
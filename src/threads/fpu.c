@@ -0,0 +1,215 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Lazy FPU and SSE context switching.
+
+   Saving and restoring the 512-byte x87/SSE state on every
+   context switch would make every thread pay for the few that
+   use floating point.  Instead, the registers are left alone on
+   a switch and CR0.TS is set, unless the incoming thread is the
+   one whose state the registers already hold.  The first FPU or
+   SSE instruction the thread executes then raises a
+   device-not-available exception (#NM), whose handler saves the
+   registers for their previous owner with FXSAVE, loads the
+   current thread's state with FXRSTOR, and clears CR0.TS so the
+   instruction can be restarted.
+
+   A thread's save area is allocated the first time it touches
+   the FPU, so threads that never do cost nothing but a pointer
+   in struct thread. */
+
+/* CR0 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR0_MP 0x00000002       /* Monitor coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) emulation. */
+#define CR0_TS 0x00000008       /* Task switched. */
+#define CR0_NE 0x00000020       /* Numeric error reporting. */
+
+/* CR4 bits. */
+#define CR4_OSFXSR 0x00000200   /* OS supports FXSAVE/FXRSTOR. */
+#define CR4_OSXMMEXCPT 0x00000400 /* OS handles SIMD exceptions. */
+
+/* CPUID leaf 1 EDX feature bits. */
+#define CPUID_EDX_FXSR (1u << 24)       /* FXSAVE/FXRSTOR. */
+#define CPUID_EDX_SSE (1u << 25)        /* SSE. */
+
+/* Size and required alignment of an FXSAVE area. */
+#define FPU_SAVE_SIZE 512
+#define FPU_SAVE_ALIGN 16
+
+/* Offsets of fields in an FXSAVE area.
+   See [IA32-v2a] "FXSAVE". */
+#define FXSAVE_FCW 0            /* x87 control word. */
+#define FXSAVE_MXCSR 24         /* SSE control and status. */
+
+/* Initial values of the x87 control word and MXCSR: all
+   exceptions masked, round to nearest, extended precision. */
+#define FCW_INIT 0x037f
+#define MXCSR_INIT 0x1f80
+
+/* Clean FPU and SSE state, loaded for a thread's first use so
+   that it does not see its predecessor's registers. */
+static uint8_t fpu_init_state[FPU_SAVE_SIZE]
+  __attribute__ ((aligned (FPU_SAVE_ALIGN)));
+
+/* True if threads may use the FPU.  See fpu.h. */
+bool fpu_enabled;
+
+/* Thread whose state is in the FPU registers, or a null pointer
+   if none. */
+static struct thread *fpu_owner;
+
+/* Statistics. */
+static long long fpu_trap_cnt;  /* # of #NM exceptions. */
+static long long fpu_save_cnt;  /* # of FXSAVEs. */
+
+static intr_handler_func fpu_trap;
+
+static inline uint32_t
+read_cr0 (void)
+{
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+static inline void
+write_cr0 (uint32_t cr0)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+}
+
+/* Returns the 16-byte aligned save area within T's allocation. */
+static void *
+save_area (struct thread *t)
+{
+  return (void *) ROUND_UP ((uintptr_t) t->fpu_area, FPU_SAVE_ALIGN);
+}
+
+/* Enables the FPU and SSE for lazy switching, if the CPU
+   supports FXSAVE and FXRSTOR.  Otherwise, leaves CR0.EM set so
+   that floating-point instructions keep faulting, as before. */
+void
+fpu_init (void) 
+{
+  uint32_t cr4;
+
+  if (!cpu_has (CPUID_EDX_FXSR))
+    return;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  cr4 |= CR4_OSFXSR;
+  if (cpu_has (CPUID_EDX_SSE))
+    cr4 |= CR4_OSXMMEXCPT;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+
+  /* Build the clean state: empty x87 stack, zeroed XMM
+     registers, default control words. */
+  memset (fpu_init_state, 0, sizeof fpu_init_state);
+  *(uint16_t *) (fpu_init_state + FXSAVE_FCW) = FCW_INIT;
+  if (cpu_has (CPUID_EDX_SSE))
+    *(uint32_t *) (fpu_init_state + FXSAVE_MXCSR) = MXCSR_INIT;
+
+  write_cr0 ((read_cr0 () & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+  intr_register_int (7, 0, INTR_ON, fpu_trap,
+                     "#NM Device Not Available Exception");
+  fpu_enabled = true;
+}
+
+/* Arranges for thread T, which is about to run, to trap on its
+   first FPU instruction unless the FPU already holds its state.
+   Called with interrupts off during a context switch. */
+void
+fpu_switch (struct thread *t) 
+{
+  uint32_t cr0, new_cr0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!fpu_enabled)
+    return;
+
+  cr0 = read_cr0 ();
+  new_cr0 = t == fpu_owner ? cr0 & ~CR0_TS : cr0 | CR0_TS;
+  if (new_cr0 != cr0)
+    write_cr0 (new_cr0);
+}
+
+/* Releases the running thread's FPU state.  Called by
+   thread_exit(). */
+void
+fpu_exit (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (fpu_owner == cur)
+    {
+      fpu_owner = NULL;
+      write_cr0 (read_cr0 () | CR0_TS);
+    }
+  intr_set_level (old_level);
+
+  free (cur->fpu_area);
+  cur->fpu_area = NULL;
+}
+
+/* Prints FPU statistics. */
+void
+fpu_print_stats (void) 
+{
+  if (fpu_enabled)
+    printf ("FPU: %lld traps, %lld saves\n", fpu_trap_cnt, fpu_save_cnt);
+}
+
+/* Device-not-available (#NM) handler.  Gives the FPU to the
+   running thread, saving its previous owner's state. */
+static void
+fpu_trap (struct intr_frame *f) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool fresh = false;
+
+  /* Allocate a save area on first use.  malloc() may sleep, so
+     do this before touching the FPU. */
+  if (cur->fpu_area == NULL)
+    {
+      cur->fpu_area = malloc (FPU_SAVE_SIZE + FPU_SAVE_ALIGN - 1);
+      if (cur->fpu_area == NULL)
+        {
+          if (f->cs == SEL_KCSEG)
+            PANIC ("out of memory for FPU state");
+          printf ("%s: out of memory for FPU state\n", thread_name ());
+          thread_exit ();
+        }
+      fresh = true;
+    }
+
+  old_level = intr_disable ();
+  fpu_trap_cnt++;
+  asm volatile ("clts");
+  if (fpu_owner != cur)
+    {
+      if (fpu_owner != NULL)
+        {
+          asm volatile ("fxsave %0" : "=m" (*(char (*)[FPU_SAVE_SIZE])
+                                            save_area (fpu_owner)));
+          fpu_save_cnt++;
+        }
+      asm volatile ("fxrstor %0"
+                    : : "m" (*(char (*)[FPU_SAVE_SIZE])
+                             (fresh ? fpu_init_state : save_area (cur))));
+      fpu_owner = cur;
+    }
+  intr_set_level (old_level);
+}
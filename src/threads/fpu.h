@@ -0,0 +1,17 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+/* True if threads may use the x87 FPU and SSE, false if they are
+   disabled because the CPU lacks FXSAVE/FXRSTOR. */
+extern bool fpu_enabled;
+
+void fpu_init (void);
+void fpu_switch (struct thread *);
+void fpu_exit (void);
+void fpu_print_stats (void);
+
+#endif /* threads/fpu.h */
@@ -15,12 +15,16 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/schedtrace.h"
+#include "threads/softirq.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -107,6 +111,7 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  fpu_init ();
   timer_init ();
   kbd_init ();
   input_init ();
@@ -117,6 +122,7 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  softirq_start ();
   serial_init_queue ();
   timer_calibrate ();
 
@@ -256,6 +262,21 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-lockprof"))
+        lock_profile = true;
+      else if (!strcmp (name, "-schedtrace"))
+        schedtrace_enabled = true;
+      else if (!strcmp (name, "-intrprof"))
+        intr_profile = true;
+      else if (!strcmp (name, "-slice"))
+        {
+          int slice = atoi (value);
+          if (slice <= 0)
+            PANIC ("time slice must be positive, not `%s'", value);
+          thread_time_slice = slice;
+        }
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -379,6 +400,11 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the periodic timer tick while idle.\n"
+          "  -lockprof          Profile contention on named kernel locks.\n"
+          "  -schedtrace        Trace scheduler events, print them at shutdown.\n"
+          "  -slice=TICKS       Give threads TICKS-tick time slices (default 4).\n"
+          "  -intrprof          Time interrupt handlers and interrupts-off periods.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
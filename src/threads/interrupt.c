@@ -3,9 +3,11 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/softirq.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
@@ -37,6 +39,35 @@ static const char *intr_names[INTR_CNT];
    unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/* Interrupt profiling.
+
+   Every interrupt is counted by vector.  With intr_profile on,
+   the TSC is also read around each handler's dispatch, and the
+   number of cycles it took is added to a per-vector histogram
+   with one bucket per power of 2.  The longest period that
+   interrupts stayed disabled is recorded too.  A period starts
+   when intr_disable() turns interrupts off, or when an interrupt
+   gate does so on entry to a handler, and ends when intr_enable()
+   or the return from the interrupt turns them back on. */
+#define INTR_HIST_BUCKETS 24    /* Last bucket takes all longer ones. */
+static unsigned long long intr_cnt[INTR_CNT];
+static unsigned intr_hist[INTR_CNT][INTR_HIST_BUCKETS];
+
+/* If false (default), interrupts are only counted.
+   If true, they are timed as described above.
+   Controlled by kernel command-line option "-intrprof". */
+bool intr_profile;
+
+/* True once intr_init() has checked that intr_profile can be
+   honored, because the CPU has a TSC. */
+static bool intr_timing;
+
+static uint64_t off_start;      /* TSC when interrupts were disabled,
+                                   0 if no period is being timed. */
+static void *off_caller;        /* Who disabled them. */
+static uint64_t off_max;        /* Longest interrupts-off period. */
+static void *off_max_caller;    /* Who disabled them for OFF_MAX. */
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
@@ -47,6 +78,11 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Softirqs run with interrupts on, so an external interrupt may
+   nest inside them.  Such an interrupt neither runs softirqs nor
+   yields; it leaves that to the code running the softirqs.  See
+   softirq.c. */
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -59,6 +95,9 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
 static void unexpected_interrupt (const struct intr_frame *);
+
+/* Profiling helpers. */
+static void record_off_period (uint64_t start, void *caller);
 
 /* Returns the current interrupt status. */
 enum intr_level
@@ -88,12 +127,17 @@ enum intr_level
 intr_enable (void) 
 {
   enum intr_level old_level = intr_get_level ();
-  ASSERT (!intr_context ());
+  ASSERT (!in_external_intr);
 
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
      Hardware Interrupts". */
+  if (old_level == INTR_OFF && intr_timing && off_start != 0)
+    {
+      record_off_period (off_start, off_caller);
+      off_start = 0;
+    }
   asm volatile ("sti");
 
   return old_level;
@@ -109,6 +153,11 @@ intr_disable (void)
      See [IA32-v2b] "CLI" and [IA32-v3a] 5.8.1 "Masking Maskable
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
+  if (old_level == INTR_ON && intr_timing)
+    {
+      off_start = rdtsc ();
+      off_caller = __builtin_return_address (0);
+    }
 
   return old_level;
 }
@@ -155,6 +204,14 @@ intr_init (void)
   intr_names[17] = "#AC Alignment Check Exception";
   intr_names[18] = "#MC Machine-Check Exception";
   intr_names[19] = "#XF SIMD Floating-Point Exception";
+
+  /* Profiling needs the TSC. */
+  if (intr_profile && !cpu_has (CPUID_EDX_TSC))
+    {
+      printf ("No TSC, disabling interrupt profiling.\n");
+      intr_profile = false;
+    }
+  intr_timing = intr_profile;
 }
 
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
@@ -206,12 +263,13 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Returns true during processing of an external interrupt or
+   of the softirqs that it raised, and false at all other
+   times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || softirq_running ();
 }
 
 /* During processing of an external interrupt, directs the
@@ -346,6 +404,7 @@ intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  uint64_t start = 0;
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
@@ -355,14 +414,27 @@ intr_handler (struct intr_frame *frame)
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
       in_external_intr = true;
-      yield_on_return = false;
+      if (!softirq_running ())
+        yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
+  intr_cnt[frame->vec_no]++;
   handler = intr_handlers[frame->vec_no];
+  if (intr_timing)
+    {
+      start = rdtsc ();
+
+      /* If the gate turned interrupts off, time that period. */
+      if ((frame->eflags & FLAG_IF) && intr_get_level () == INTR_OFF)
+        {
+          off_start = start;
+          off_caller = handler;
+        }
+    }
   if (handler != NULL)
     handler (frame);
   else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
@@ -373,6 +445,21 @@ intr_handler (struct intr_frame *frame)
     }
   else
     unexpected_interrupt (frame);
+  if (intr_timing)
+    {
+      uint64_t cycles = rdtsc () - start;
+      uint32_t high = cycles >> 32;
+      int bucket;
+
+      /* Bucket B holds durations in [2**(B-1), 2**B). */
+      if (high != 0)
+        bucket = 64 - __builtin_clz (high);
+      else
+        bucket = (uint32_t) cycles != 0 ? 32 - __builtin_clz (cycles) : 0;
+      if (bucket >= INTR_HIST_BUCKETS)
+        bucket = INTR_HIST_BUCKETS - 1;
+      intr_hist[frame->vec_no][bucket]++;
+    }
 
   /* Complete the processing of an external interrupt. */
   if (external) 
@@ -383,8 +470,22 @@ intr_handler (struct intr_frame *frame)
       in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
 
-      if (yield_on_return) 
-        thread_yield (); 
+      if (!softirq_running ())
+        {
+          if (softirq_pending ())
+            softirq_run ();
+          if (yield_on_return) 
+            thread_yield (); 
+        }
+    }
+
+  /* Returning to the interrupted code will turn interrupts back
+     on, ending the current interrupts-off period. */
+  if (intr_timing && (frame->eflags & FLAG_IF)
+      && intr_get_level () == INTR_OFF && off_start != 0)
+    {
+      record_off_period (off_start, off_caller);
+      off_start = 0;
     }
 }
 
@@ -406,6 +507,53 @@ unexpected_interrupt (const struct intr_frame *f)
     f->vec_no, intr_names[f->vec_no]);
 }
 
+/* Records that interrupts were disabled from TSC value START
+   until now by CALLER, if that is the longest such period yet. */
+static void
+record_off_period (uint64_t start, void *caller)
+{
+  uint64_t cycles = rdtsc () - start;
+
+  if (cycles > off_max)
+    {
+      off_max = cycles;
+      off_max_caller = caller;
+    }
+}
+
+/* Prints interrupt statistics. */
+void
+intr_print_stats (void) 
+{
+  int vec;
+
+  for (vec = 0; vec < INTR_CNT; vec++)
+    {
+      int i;
+
+      if (intr_cnt[vec] == 0)
+        continue;
+      printf ("Interrupt %#04x (%s): %llu", vec, intr_names[vec],
+              intr_cnt[vec]);
+      if (intr_profile)
+        {
+          printf (", cycles:");
+          for (i = 0; i < INTR_HIST_BUCKETS; i++)
+            if (intr_hist[vec][i] != 0)
+              {
+                if (i < INTR_HIST_BUCKETS - 1)
+                  printf (" <2^%d:%u", i, intr_hist[vec][i]);
+                else
+                  printf (" >=2^%d:%u", i - 1, intr_hist[vec][i]);
+              }
+        }
+      printf ("\n");
+    }
+  if (intr_profile)
+    printf ("Interrupts off for at most %llu cycles, disabled at %p\n",
+            off_max, off_max_caller);
+}
+
 /* Dumps interrupt frame F to the console, for debugging. */
 void
 intr_dump_frame (const struct intr_frame *f) 
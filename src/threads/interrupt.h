@@ -15,6 +15,11 @@ enum intr_level intr_get_level (void);
 enum intr_level intr_set_level (enum intr_level);
 enum intr_level intr_enable (void);
 enum intr_level intr_disable (void);
+
+/* If false (default), interrupts are only counted.  If true,
+   handler durations and interrupts-off periods are measured.
+   Controlled by kernel command-line option "-intrprof". */
+extern bool intr_profile;
 
 /* Interrupt stack frame. */
 struct intr_frame
@@ -65,6 +70,7 @@ bool intr_context (void);
 void intr_yield_on_return (void);
 
 void intr_dump_frame (const struct intr_frame *);
+void intr_print_stats (void);
 const char *intr_name (uint8_t vec);
 
 #endif /* threads/interrupt.h */
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +33,24 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   For blocks of up to FAST_MAX_SIZE bytes, each descriptor also
+   keeps a small LIFO "magazine" of free blocks, linked through
+   their first word and accessed with interrupts briefly off
+   instead of under the descriptor's lock.  Blocks in a magazine
+   still count as in use in their arenas.  When the magazine is
+   empty, malloc() takes the lock and refills it with up to
+   FAST_BATCH blocks from the free list; when it is full, free()
+   moves FAST_BATCH blocks back to the free list. */
+
+/* Largest block size with a magazine. */
+#define FAST_MAX_SIZE 256
+
+/* Most blocks in a magazine, and number of blocks moved into or
+   out of one at a time. */
+#define FAST_MAX 32
+#define FAST_BATCH 16
 
 /* Descriptor. */
 struct desc
@@ -41,6 +59,9 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    char name[16];              /* Name of LOCK, for statistics. */
+    void *fast_list;            /* Magazine, with interrupts off. */
+    size_t fast_cnt;            /* Number of blocks in magazine. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -66,6 +87,10 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *take_block (struct desc *);
+static void release_block (struct desc *, struct block *);
+static struct block *fast_pop (struct desc *);
+static bool fast_push (struct desc *, struct block *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -80,7 +105,10 @@ malloc_init (void)
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
-      lock_init (&d->lock);
+      d->fast_list = NULL;
+      d->fast_cnt = 0;
+      snprintf (d->name, sizeof d->name, "malloc %zu", block_size);
+      lock_init_adaptive (&d->lock, d->name, LOCK_ADAPTIVE_SPINS);
     }
 }
 
@@ -119,7 +147,45 @@ malloc (size_t size)
       return a + 1;
     }
 
+  /* Try the magazine first. */
+  if (d->block_size <= FAST_MAX_SIZE)
+    {
+      b = fast_pop (d);
+      if (b != NULL)
+        return b;
+    }
+
   lock_acquire (&d->lock);
+  b = take_block (d);
+  if (b != NULL && d->block_size <= FAST_MAX_SIZE)
+    {
+      /* Refill the magazine from the free list. */
+      size_t i;
+
+      for (i = 1; i < FAST_BATCH && !list_empty (&d->free_list); i++)
+        {
+          struct block *extra = list_entry (list_pop_front (&d->free_list),
+                                            struct block, free_elem);
+          block_to_arena (extra)->free_cnt--;
+          if (!fast_push (d, extra))
+            {
+              release_block (d, extra);
+              break;
+            }
+        }
+    }
+  lock_release (&d->lock);
+  return b;
+}
+
+/* Takes a block from D's free list, creating a new arena if the
+   list is empty.  Returns the block, or a null pointer if memory
+   is not available.  D's lock must be held. */
+static struct block *
+take_block (struct desc *d) 
+{
+  struct block *b;
+  struct arena *a;
 
   /* If the free list is empty, create a new arena. */
   if (list_empty (&d->free_list))
@@ -129,10 +195,7 @@ malloc (size_t size)
       /* Allocate a page. */
       a = palloc_get_page (0);
       if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
+        return NULL; 
 
       /* Initialize arena and add its blocks to the free list. */
       a->magic = ARENA_MAGIC;
@@ -149,7 +212,6 @@ malloc (size_t size)
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
-  lock_release (&d->lock);
   return b;
 }
 
@@ -232,26 +294,26 @@ free (void *p)
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
+
+          /* Put it in the magazine if there is room. */
+          if (d->block_size <= FAST_MAX_SIZE && fast_push (d, b))
+            return;
   
           lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          release_block (d, b);
+          if (d->block_size <= FAST_MAX_SIZE)
             {
+              /* Magazine was full.  Move a batch back. */
               size_t i;
 
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
+              for (i = 0; i < FAST_BATCH; i++)
                 {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
+                  struct block *extra = fast_pop (d);
+                  if (extra == NULL)
+                    break;
+                  release_block (d, extra);
                 }
-              palloc_free_page (a);
             }
-
           lock_release (&d->lock);
         }
       else
@@ -263,6 +325,66 @@ free (void *p)
     }
 }
 
+/* Adds block B to D's free list, freeing its arena if it is
+   now entirely unused.  D's lock must be held. */
+static void
+release_block (struct desc *d, struct block *b) 
+{
+  struct arena *a = block_to_arena (b);
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      palloc_free_page (a);
+    }
+}
+
+/* Takes a block from D's magazine.  Returns the block, or a null
+   pointer if the magazine is empty. */
+static struct block *
+fast_pop (struct desc *d) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct block *b = d->fast_list;
+
+  if (b != NULL)
+    {
+      d->fast_list = *(void **) b;
+      d->fast_cnt--;
+    }
+  intr_set_level (old_level);
+  return b;
+}
+
+/* Puts block B in D's magazine and returns true, or returns
+   false if the magazine is full. */
+static bool
+fast_push (struct desc *d, struct block *b) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool ok = d->fast_cnt < FAST_MAX;
+
+  if (ok)
+    {
+      *(void **) b = d->fast_list;
+      d->fast_list = b;
+      d->fast_cnt++;
+    }
+  intr_set_level (old_level);
+  return ok;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
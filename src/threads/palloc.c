@@ -2,11 +2,13 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,14 +25,95 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, pages are managed by a binary buddy system.
+   Free pages are kept as blocks of 2**ORDER pages, aligned to
+   their size relative to the pool base, on one free list per
+   order.  A request for PAGE_CNT pages takes the smallest block
+   that fits, splitting larger blocks in half as needed, and
+   gives the pages past PAGE_CNT back at once, so no memory is
+   lost to rounding.  Freed pages are merged with their free
+   "buddy" blocks into ever larger blocks.  Both take time
+   logarithmic in the size of the pool.
+
+   The scheduler frees the pages of dying threads with interrupts
+   off, when it may not take the pool lock.  If no thread holds
+   the lock then, nothing can get in the way of freeing the pages
+   at once.  Otherwise, the pages are put on the pool's deferred
+   list, and the lock holder frees them before releasing it.
+
+   Single pages, by far the most common request, mostly bypass
+   the lock and the buddy system altogether.  Each pool keeps a
+   small LIFO cache of free pages, accessed with interrupts
+   briefly off.  An empty cache is refilled with PAGE_CACHE_BATCH
+   pages under the lock, and a full one has PAGE_CACHE_BATCH
+   pages drained back to the buddy system.  Cached pages are
+   still marked used in used_map.
+
+   Zeroing pages for PAL_ZERO is moved off the allocation path as
+   well.  When it has nothing else to do, the idle thread calls
+   palloc_zero_idle(), which takes free pages, zeros them, and
+   puts them on their pool's list of pre-zeroed pages, where a
+   single-page PAL_ZERO request looks first.  The idle thread may
+   not sleep, so it only takes pages when it needs no lock to do
+   so.  Before an allocation fails for lack of memory, cached and
+   pre-zeroed pages are given back to the buddy system. */
+
+/* Number of block orders.  A block of the largest order spans
+   2**(BUDDY_ORDERS - 1) pages, 2 GB, more than Pintos can use. */
+#define BUDDY_ORDERS 20
+
+/* Most pages in a pool's page cache, and number of pages moved
+   into or out of it at a time. */
+#define PAGE_CACHE_MAX 32
+#define PAGE_CACHE_BATCH 16
+
+/* Most pre-zeroed pages kept in a pool. */
+#define ZEROED_MAX 32
 
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *order_map;                 /* Per page: 1 + order of the free
+                                           block it starts, or 0. */
+    struct list free_lists[BUDDY_ORDERS];  /* Free blocks, by order. */
+    size_t free_blocks[BUDDY_ORDERS];   /* Length of each free list. */
+    size_t free_pages;                  /* Number of free pages. */
+    struct list deferred;               /* Pages waiting to be freed. */
+
+    /* Page cache.  Accessed with interrupts off. */
+    void *cache;                        /* Cached pages, linked through
+                                           their first word. */
+    size_t cache_cnt;                   /* Number of cached pages. */
+    long long cache_hits;               /* Single pages taken from cache. */
+    long long cache_refills;            /* Refills of an empty cache. */
+    long long cache_drains;             /* Drains of a full cache. */
+
+    /* Pre-zeroed pages.  Accessed with interrupts off. */
+    void *zeroed;                       /* Zeroed pages, linked through
+                                           their first word. */
+    size_t zeroed_cnt;                  /* Number of zeroed pages. */
+    long long zeroed_hits;              /* PAL_ZERO pages taken from list. */
+    long long zeroed_misses;            /* PAL_ZERO pages zeroed on demand. */
+
     uint8_t *base;                      /* Base of pool. */
+    const char *name;                   /* Name, for statistics. */
+  };
+
+/* A free block, stored in its own first page. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in a free list. */
+  };
+
+/* Pages on a deferred list, described in their own first page. */
+struct deferred_free
+  {
+    struct list_elem elem;              /* Element in deferred list. */
+    size_t page_cnt;                    /* Number of pages. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +122,18 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void release_pages (struct pool *, void *pages, size_t page_cnt);
+static void unlock_pool (struct pool *);
+static void *take_pages (struct pool *, size_t page_cnt);
+static void *get_cached_page (struct pool *);
+static bool put_cached_page (struct pool *, void *page);
+static void drain_cache (struct pool *, void *page);
+static bool reclaim_pages (struct pool *);
+static void *get_zeroed_page (struct pool *);
+static bool zero_page (struct pool *);
+static void print_pool_stats (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -72,24 +167,37 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
-  size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if (page_cnt == 1 && (flags & PAL_ZERO)
+      && (pages = get_zeroed_page (pool)) != NULL)
+    return pages;
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+  if (page_cnt == 1)
+    pages = get_cached_page (pool);
   else
-    pages = NULL;
+    {
+      lock_acquire (&pool->lock);
+      pages = take_pages (pool, page_cnt);
+      if (pages == NULL && reclaim_pages (pool))
+        pages = take_pages (pool, page_cnt);
+      unlock_pool (pool);
+    }
 
   if (pages != NULL) 
     {
       if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+        {
+          memset (pages, 0, PGSIZE * page_cnt);
+          if (page_cnt == 1)
+            {
+              enum intr_level old_level = intr_disable ();
+              pool->zeroed_misses++;
+              intr_set_level (old_level);
+            }
+        }
     }
   else 
     {
@@ -118,7 +226,6 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
-  size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -131,14 +238,40 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   else
     NOT_REACHED ();
 
-  page_idx = pg_no (pages) - pg_no (pool->base);
-
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  if (page_cnt == 1)
+    {
+      enum intr_level old_level = intr_disable ();
+      bool cached = put_cached_page (pool, pages);
+      intr_set_level (old_level);
+      if (cached)
+        return;
+      if (old_level == INTR_ON)
+        {
+          drain_cache (pool, pages);
+          return;
+        }
+    }
+
+  if (intr_get_level () == INTR_OFF)
+    {
+      if (pool->lock.holder == NULL)
+        release_pages (pool, pages, page_cnt);
+      else
+        {
+          struct deferred_free *d = pages;
+          d->page_cnt = page_cnt;
+          list_push_back (&pool->deferred, &d->elem);
+        }
+      return;
+    }
+
+  lock_acquire (&pool->lock);
+  release_pages (pool, pages, page_cnt);
+  unlock_pool (pool);
 }
 
 /* Frees the page at PAGE. */
@@ -148,15 +281,38 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeros a free page, if one can be had without sleeping, and
+   keeps it for a later PAL_ZERO request.  Returns true if a page
+   was zeroed, false if there was nothing to do.  Called by the
+   idle thread, with interrupts on. */
+bool
+palloc_zero_idle (void) 
+{
+  ASSERT (intr_get_level () == INTR_ON);
+
+  return zero_page (&kernel_pool) || zero_page (&user_pool);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) 
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and order_map at its base.
+     Calculate the space needed for them and subtract it from the
+     pool's size. */
+  size_t bm_size = ROUND_UP (bitmap_buf_size (page_cnt), sizeof (long));
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -164,9 +320,28 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  lock_init_adaptive (&p->lock, name, LOCK_ADAPTIVE_SPINS);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->order_map = (uint8_t *) base + bm_size;
+  memset (p->order_map, 0, page_cnt);
+  for (order = 0; order < BUDDY_ORDERS; order++)
+    {
+      list_init (&p->free_lists[order]);
+      p->free_blocks[order] = 0;
+    }
+  p->free_pages = 0;
+  list_init (&p->deferred);
+  p->cache = NULL;
+  p->cache_cnt = 0;
+  p->cache_hits = p->cache_refills = p->cache_drains = 0;
+  p->zeroed = NULL;
+  p->zeroed_cnt = 0;
+  p->zeroed_hits = p->zeroed_misses = 0;
   p->base = base + bm_pages * PGSIZE;
+  p->name = name;
+
+  /* Put all the pages in the free lists. */
+  buddy_free (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -180,3 +355,375 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free block that starts at page PAGE_IDX in POOL. */
+static struct free_block *
+block_at (struct pool *pool, size_t page_idx) 
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX to POOL's free
+   lists, without merging it with its buddy. */
+static void
+insert_block (struct pool *pool, size_t page_idx, int order) 
+{
+  ASSERT (pool->order_map[page_idx] == 0);
+
+  pool->order_map[page_idx] = order + 1;
+  list_push_front (&pool->free_lists[order],
+                   &block_at (pool, page_idx)->elem);
+  pool->free_blocks[order]++;
+  pool->free_pages += (size_t) 1 << order;
+}
+
+/* Removes the free block of 2**ORDER pages at PAGE_IDX from
+   POOL's free lists. */
+static void
+remove_block (struct pool *pool, size_t page_idx, int order) 
+{
+  ASSERT (pool->order_map[page_idx] == order + 1);
+
+  pool->order_map[page_idx] = 0;
+  list_remove (&block_at (pool, page_idx)->elem);
+  pool->free_blocks[order]--;
+  pool->free_pages -= (size_t) 1 << order;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL,
+   merging it with its buddy for as long as the buddy is free. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  size_t page_cnt = bitmap_size (pool->used_map);
+
+  for (; order + 1 < BUDDY_ORDERS; order++)
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+      if (buddy_idx + ((size_t) 1 << order) > page_cnt
+          || pool->order_map[buddy_idx] != order + 1)
+        break;
+
+      remove_block (pool, buddy_idx, order);
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+    }
+  insert_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in POOL, splitting them
+   into the largest aligned blocks that fit. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+      while (order + 1 < BUDDY_ORDERS
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && (size_t) 2 << order <= page_cnt)
+        order++;
+
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if no free block is large
+   enough. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) 
+{
+  int want, order;
+  size_t page_idx;
+
+  /* Find the smallest free block with at least PAGE_CNT pages. */
+  for (want = 0; want < BUDDY_ORDERS; want++)
+    if (((size_t) 1 << want) >= page_cnt)
+      break;
+  for (order = want; order < BUDDY_ORDERS; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  if (order >= BUDDY_ORDERS)
+    return BITMAP_ERROR;
+
+  page_idx = pg_no (list_front (&pool->free_lists[order]))
+             - pg_no (pool->base);
+  remove_block (pool, page_idx, order);
+
+  /* Split off and free upper halves until the block is the
+     smallest power of two that fits, then give back the pages
+     beyond PAGE_CNT. */
+  while (order > want)
+    {
+      order--;
+      insert_block (pool, page_idx + ((size_t) 1 << order), order);
+    }
+  buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+
+  return page_idx;
+}
+
+/* Prints statistics for POOL: the number of free pages, the
+   largest run of free pages, and the free blocks of each order. */
+static void
+print_pool_stats (struct pool *pool) 
+{
+  size_t page_cnt = bitmap_size (pool->used_map);
+  size_t largest_run = 0;
+  size_t run = 0;
+  size_t i;
+  int order;
+
+  lock_acquire (&pool->lock);
+  for (i = 0; i < page_cnt; i++)
+    {
+      run = bitmap_test (pool->used_map, i) ? 0 : run + 1;
+      if (run > largest_run)
+        largest_run = run;
+    }
+
+  printf ("Palloc: %s: %zu of %zu pages free, largest free run %zu pages\n",
+          pool->name, pool->free_pages, page_cnt, largest_run);
+  printf ("Palloc: %s: free blocks by order:", pool->name);
+  for (order = 0; order < BUDDY_ORDERS; order++)
+    if (pool->free_blocks[order] > 0)
+      printf (" %d:%zu", order, pool->free_blocks[order]);
+  printf ("\n");
+  printf ("Palloc: %s: %zu pages cached, %lld cache hits, "
+          "%lld refills, %lld drains\n", pool->name, pool->cache_cnt,
+          pool->cache_hits, pool->cache_refills, pool->cache_drains);
+  printf ("Palloc: %s: %zu pages pre-zeroed, %lld zeroed pages "
+          "served pre-zeroed, %lld zeroed on demand\n", pool->name,
+          pool->zeroed_cnt, pool->zeroed_hits, pool->zeroed_misses);
+  unlock_pool (pool);
+}
+
+/* Returns the PAGE_CNT pages at PAGES to POOL.  The caller must
+   hold POOL's lock, or have interrupts off while nobody holds
+   it. */
+static void
+release_pages (struct pool *pool, void *pages, size_t page_cnt) 
+{
+  size_t page_idx = pg_no (pages) - pg_no (pool->base);
+
+  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  buddy_free (pool, page_idx, page_cnt);
+}
+
+/* Frees the pages on POOL's deferred list, then releases POOL's
+   lock, which the caller must hold.  The lock is released with
+   interrupts back at their old level, so that a higher-priority
+   waiter it wakes preempts us at once.  Pages deferred in the
+   window before the release wait for the lock's next holder. */
+static void
+unlock_pool (struct pool *pool) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  while (!list_empty (&pool->deferred))
+    {
+      struct deferred_free *d = list_entry (list_pop_front (&pool->deferred),
+                                            struct deferred_free, elem);
+      release_pages (pool, d, d->page_cnt);
+    }
+  intr_set_level (old_level);
+  lock_release (&pool->lock);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL's buddy system
+   and returns the first, or a null pointer if there are not
+   enough.  The caller must hold POOL's lock. */
+static void *
+take_pages (struct pool *pool, size_t page_cnt) 
+{
+  size_t page_idx = buddy_alloc (pool, page_cnt);
+
+  if (page_idx == BITMAP_ERROR)
+    return NULL;
+
+  ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+  return pool->base + PGSIZE * page_idx;
+}
+
+/* Takes a page from POOL's page cache, refilling it from the
+   buddy system if it is empty.  Returns the page, or a null
+   pointer if POOL has no free pages. */
+static void *
+get_cached_page (struct pool *pool) 
+{
+  enum intr_level old_level;
+  void *page;
+  int i;
+
+  old_level = intr_disable ();
+  page = pool->cache;
+  if (page != NULL)
+    {
+      pool->cache = *(void **) page;
+      pool->cache_cnt--;
+      pool->cache_hits++;
+    }
+  else
+    pool->cache_refills++;
+  intr_set_level (old_level);
+  if (page != NULL)
+    return page;
+
+  /* Cache is empty.  Refill it with a batch of pages. */
+  lock_acquire (&pool->lock);
+  page = take_pages (pool, 1);
+  if (page == NULL && reclaim_pages (pool))
+    page = take_pages (pool, 1);
+  for (i = 1; page != NULL && i < PAGE_CACHE_BATCH; i++)
+    {
+      void *extra = take_pages (pool, 1);
+      if (extra == NULL)
+        break;
+
+      old_level = intr_disable ();
+      if (!put_cached_page (pool, extra))
+        release_pages (pool, extra, 1);
+      intr_set_level (old_level);
+    }
+  unlock_pool (pool);
+
+  return page;
+}
+
+/* Puts PAGE in POOL's page cache and returns true, or returns
+   false if the cache is full.  Interrupts must be off. */
+static bool
+put_cached_page (struct pool *pool, void *page) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (pool->cache_cnt >= PAGE_CACHE_MAX)
+    return false;
+
+  *(void **) page = pool->cache;
+  pool->cache = page;
+  pool->cache_cnt++;
+  return true;
+}
+
+/* Returns PAGE, which did not fit in POOL's full page cache, to
+   the buddy system along with a batch of pages from the cache. */
+static void
+drain_cache (struct pool *pool, void *page) 
+{
+  enum intr_level old_level;
+  void *batch = NULL;
+  int i;
+
+  lock_acquire (&pool->lock);
+
+  old_level = intr_disable ();
+  for (i = 0; i < PAGE_CACHE_BATCH && pool->cache != NULL; i++)
+    {
+      void *p = pool->cache;
+      pool->cache = *(void **) p;
+      pool->cache_cnt--;
+      *(void **) p = batch;
+      batch = p;
+    }
+  pool->cache_drains++;
+  intr_set_level (old_level);
+
+  release_pages (pool, page, 1);
+  while (batch != NULL)
+    {
+      void *p = batch;
+      batch = *(void **) p;
+      release_pages (pool, p, 1);
+    }
+  unlock_pool (pool);
+}
+
+/* Gives all of POOL's cached and pre-zeroed pages back to the
+   buddy system.  Returns true if there were any.  The caller
+   must hold POOL's lock. */
+static bool
+reclaim_pages (struct pool *pool) 
+{
+  enum intr_level old_level;
+  void *lists[2];
+  bool reclaimed;
+  int i;
+
+  old_level = intr_disable ();
+  lists[0] = pool->cache;
+  lists[1] = pool->zeroed;
+  reclaimed = lists[0] != NULL || lists[1] != NULL;
+  pool->cache = pool->zeroed = NULL;
+  pool->cache_cnt = pool->zeroed_cnt = 0;
+  intr_set_level (old_level);
+
+  for (i = 0; i < 2; i++)
+    while (lists[i] != NULL)
+      {
+        void *p = lists[i];
+        lists[i] = *(void **) p;
+        release_pages (pool, p, 1);
+      }
+  return reclaimed;
+}
+
+/* Takes a page from POOL's pre-zeroed pages.  Returns the page,
+   or a null pointer if there are none. */
+static void *
+get_zeroed_page (struct pool *pool) 
+{
+  enum intr_level old_level = intr_disable ();
+  void **page = pool->zeroed;
+
+  if (page != NULL)
+    {
+      pool->zeroed = *page;
+      pool->zeroed_cnt--;
+      pool->zeroed_hits++;
+      *page = NULL;
+    }
+  intr_set_level (old_level);
+  return page;
+}
+
+/* Zeros a page for POOL's pre-zeroed pages, taking it from the
+   page cache, or from the buddy system if no thread holds the
+   lock.  Returns true if successful, false if POOL has enough
+   zeroed pages or there was no page to take.  Never sleeps. */
+static bool
+zero_page (struct pool *pool) 
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (pool->zeroed_cnt < ZEROED_MAX)
+    {
+      page = pool->cache;
+      if (page != NULL)
+        {
+          pool->cache = *(void **) page;
+          pool->cache_cnt--;
+        }
+      else if (pool->lock.holder == NULL)
+        page = take_pages (pool, 1);
+    }
+  intr_set_level (old_level);
+  if (page == NULL)
+    return false;
+
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  *(void **) page = pool->zeroed;
+  pool->zeroed = page;
+  pool->zeroed_cnt++;
+  intr_set_level (old_level);
+  return true;
+}
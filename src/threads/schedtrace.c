@@ -0,0 +1,83 @@
+#include "threads/schedtrace.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "devices/timer.h"
+
+/* Scheduler event trace.
+
+   Events are recorded from the scheduler itself, with interrupts
+   off, into a fixed-size ring buffer that overwrites its oldest
+   entries.  Recording takes no lock and never allocates, so it
+   may be done from an interrupt handler and from the middle of a
+   context switch.
+
+   At shutdown the buffer is printed, one event per line, for
+   utils/schedtrace to analyze on the host. */
+
+/* Number of events kept.  Must be a power of 2. */
+#define SCHEDTRACE_SIZE 2048
+
+/* One recorded event. */
+struct schedtrace_event
+  {
+    int64_t tick;               /* timer_ticks() at the event. */
+    int64_t ns;                 /* timer_ns() at the event. */
+    enum schedtrace_type type;  /* Kind of event. */
+    int tid;                    /* Thread the event concerns. */
+    int arg;                    /* Type-specific argument. */
+  };
+
+/* If false (default), scheduler events are not recorded.
+   If true, see above.
+   Controlled by kernel command-line option "-schedtrace". */
+bool schedtrace_enabled;
+
+static struct schedtrace_event events[SCHEDTRACE_SIZE];
+static uint64_t event_cnt;      /* # of events ever recorded. */
+
+/* Records an event of the given TYPE for thread TID with the
+   type-specific ARG, if tracing is enabled.  Interrupts must be
+   off. */
+void
+schedtrace_record (enum schedtrace_type type, int tid, int arg)
+{
+  struct schedtrace_event *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!schedtrace_enabled)
+    return;
+  e = &events[event_cnt++ & (SCHEDTRACE_SIZE - 1)];
+  e->tick = timer_ticks ();
+  e->ns = timer_ns ();
+  e->type = type;
+  e->tid = tid;
+  e->arg = arg;
+}
+
+/* Prints the recorded events, oldest first. */
+void
+schedtrace_dump (void) 
+{
+  static const char *names[] =
+    {"switch", "wakeup", "block", "preempt", "donate"};
+  uint64_t first, i;
+
+  if (!schedtrace_enabled)
+    return;
+
+  /* Stop recording, so that our own printing does not overwrite
+     the events we are about to print. */
+  schedtrace_enabled = false;
+
+  first = event_cnt > SCHEDTRACE_SIZE ? event_cnt - SCHEDTRACE_SIZE : 0;
+  printf ("schedtrace: %llu events, %llu lost\n", event_cnt - first, first);
+  for (i = first; i < event_cnt; i++)
+    {
+      struct schedtrace_event *e = &events[i & (SCHEDTRACE_SIZE - 1)];
+      printf ("schedtrace: %lld %lld %s %d %d\n",
+              e->tick, e->ns, names[e->type], e->tid, e->arg);
+    }
+}
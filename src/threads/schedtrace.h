@@ -0,0 +1,26 @@
+#ifndef THREADS_SCHEDTRACE_H
+#define THREADS_SCHEDTRACE_H
+
+#include <stdbool.h>
+
+/* Kinds of scheduler events. */
+enum schedtrace_type
+  {
+    SCHED_SWITCH,               /* TID switched to thread ARG. */
+    SCHED_WAKEUP,               /* TID made ready by thread ARG. */
+    SCHED_BLOCK,                /* TID blocked. */
+    SCHED_PREEMPT,              /* TID preempted (ARG = 1 for end of
+                                   time slice, 0 for higher priority). */
+    SCHED_DONATE                /* TID received priority ARG. */
+  };
+
+/* If false (default), scheduler events are not recorded.  If
+   true, they are recorded in a ring buffer that is dumped at
+   shutdown.
+   Controlled by kernel command-line option "-schedtrace". */
+extern bool schedtrace_enabled;
+
+void schedtrace_record (enum schedtrace_type, int tid, int arg);
+void schedtrace_dump (void);
+
+#endif /* threads/schedtrace.h */
@@ -0,0 +1,259 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator.
+
+   malloc() rounds each request up to a power of 2, which wastes
+   up to half of each block.  A slab cache instead hands out
+   objects of one exact size, for kernel structures that are
+   allocated and freed often.
+
+   Each slab is a page that starts with a struct slab header,
+   followed by the objects.  The space left over after the last
+   whole object is split between the front and the back of the
+   slab: successive slabs start their objects at different
+   "color" offsets, in steps of SLAB_COLOR_ALIGN bytes, so that
+   the same object in different slabs does not always map to the
+   same cache lines.
+
+   Free objects in a slab are linked through their first word.
+   A cache keeps its slabs on three lists, by whether they are
+   partly used, full, or empty.  Allocation prefers partly used
+   slabs, to keep the number of slabs low.  At most one empty
+   slab is kept per cache; others go back to the page allocator.
+
+   The optional constructor runs on every allocation, after the
+   object leaves the free list, so it may initialize the whole
+   object. */
+
+/* Step between slab colors, about one cache line. */
+#define SLAB_COLOR_ALIGN 32
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of cache's lists. */
+    void *free;                 /* Free objects, linked through their
+                                   first word. */
+    size_t used_cnt;            /* Number of objects in use. */
+  };
+
+/* All slab caches, for statistics.  Accessed with interrupts
+   off. */
+static struct list all_caches = LIST_INITIALIZER (all_caches);
+
+static struct slab *new_slab (struct slab_cache *);
+static struct slab *obj_to_slab (struct slab_cache *, void *);
+
+/* Initializes CACHE to allocate objects of OBJ_SIZE bytes,
+   calling CTOR, if nonnull, on each allocated object.  NAME
+   identifies the cache in statistics. */
+void
+slab_cache_init (struct slab_cache *cache, const char *name,
+                 size_t obj_size, slab_ctor *ctor) 
+{
+  enum intr_level old_level;
+  size_t space = PGSIZE - sizeof (struct slab);
+  size_t leftover;
+
+  ASSERT (cache != NULL);
+  ASSERT (name != NULL);
+
+  /* Objects must hold a free-list link and stay word-aligned. */
+  if (obj_size < sizeof (void *))
+    obj_size = sizeof (void *);
+  obj_size = ROUND_UP (obj_size, sizeof (void *));
+  ASSERT (obj_size <= space);
+
+  cache->name = name;
+  cache->obj_size = obj_size;
+  cache->objs_per_slab = space / obj_size;
+  leftover = space - cache->objs_per_slab * obj_size;
+  cache->color_cnt = leftover / SLAB_COLOR_ALIGN + 1;
+  cache->next_color = 0;
+  cache->ctor = ctor;
+  lock_init_named (&cache->lock, name);
+  list_init (&cache->partial);
+  list_init (&cache->full);
+  list_init (&cache->empty);
+  cache->alloc_cnt = 0;
+  cache->slab_cnt = 0;
+  cache->used_cnt = 0;
+  cache->max_used_cnt = 0;
+
+  old_level = intr_disable ();
+  list_push_back (&all_caches, &cache->elem);
+  intr_set_level (old_level);
+}
+
+/* Allocates and returns an object from CACHE, or a null pointer
+   if memory is not available. */
+void *
+slab_alloc (struct slab_cache *cache) 
+{
+  struct slab *slab;
+  void *obj;
+
+  lock_acquire (&cache->lock);
+
+  /* Find a slab with a free object, creating one if needed. */
+  if (!list_empty (&cache->partial))
+    slab = list_entry (list_front (&cache->partial), struct slab, elem);
+  else if (!list_empty (&cache->empty))
+    {
+      slab = list_entry (list_pop_front (&cache->empty), struct slab, elem);
+      list_push_front (&cache->partial, &slab->elem);
+    }
+  else
+    {
+      slab = new_slab (cache);
+      if (slab == NULL)
+        {
+          lock_release (&cache->lock);
+          return NULL;
+        }
+      list_push_front (&cache->partial, &slab->elem);
+    }
+
+  /* Take an object from it. */
+  obj = slab->free;
+  slab->free = *(void **) obj;
+  if (++slab->used_cnt == cache->objs_per_slab)
+    {
+      list_remove (&slab->elem);
+      list_push_front (&cache->full, &slab->elem);
+    }
+
+  cache->alloc_cnt++;
+  if (++cache->used_cnt > cache->max_used_cnt)
+    cache->max_used_cnt = cache->used_cnt;
+  lock_release (&cache->lock);
+
+  if (cache->ctor != NULL)
+    cache->ctor (obj);
+  return obj;
+}
+
+/* Frees OBJ, which must have been allocated from CACHE.  Does
+   nothing if OBJ is a null pointer. */
+void
+slab_free (struct slab_cache *cache, void *obj) 
+{
+  struct slab *slab;
+
+  if (obj == NULL)
+    return;
+
+  slab = obj_to_slab (cache, obj);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  memset (obj, 0xcc, cache->obj_size);
+#endif
+
+  lock_acquire (&cache->lock);
+  ASSERT (slab->used_cnt > 0);
+
+  *(void **) obj = slab->free;
+  slab->free = obj;
+  cache->used_cnt--;
+
+  if (slab->used_cnt-- == cache->objs_per_slab)
+    {
+      /* Slab was full. */
+      list_remove (&slab->elem);
+      list_push_front (&cache->partial, &slab->elem);
+    }
+  if (slab->used_cnt == 0)
+    {
+      /* Slab is now empty.  Keep it if it is the only one. */
+      list_remove (&slab->elem);
+      if (list_empty (&cache->empty))
+        list_push_front (&cache->empty, &slab->elem);
+      else
+        {
+          slab->magic = 0;
+          cache->slab_cnt--;
+          palloc_free_page (slab);
+        }
+    }
+
+  lock_release (&cache->lock);
+}
+
+/* Prints statistics for each slab cache. */
+void
+slab_print_stats (void) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct slab_cache *c = list_entry (e, struct slab_cache, elem);
+      printf ("Slab: %s: %zu-byte objects, %zu per slab, "
+              "%zu in use (max %zu), %zu slabs, %lld allocated\n",
+              c->name, c->obj_size, c->objs_per_slab, c->used_cnt,
+              c->max_used_cnt, c->slab_cnt, c->alloc_cnt);
+    }
+}
+
+/* Obtains a new slab for CACHE and links all its objects into
+   its free list.  Returns the slab, or a null pointer if memory
+   is not available.  CACHE's lock must be held. */
+static struct slab *
+new_slab (struct slab_cache *cache) 
+{
+  struct slab *slab = palloc_get_page (0);
+  uint8_t *obj;
+  size_t color;
+  size_t i;
+
+  if (slab == NULL)
+    return NULL;
+
+  color = cache->next_color * SLAB_COLOR_ALIGN;
+  if (++cache->next_color >= cache->color_cnt)
+    cache->next_color = 0;
+
+  slab->magic = SLAB_MAGIC;
+  slab->cache = cache;
+  slab->used_cnt = 0;
+  slab->free = NULL;
+  obj = (uint8_t *) (slab + 1) + color;
+  for (i = cache->objs_per_slab; i-- > 0; )
+    {
+      void *o = obj + i * cache->obj_size;
+      *(void **) o = slab->free;
+      slab->free = o;
+    }
+
+  cache->slab_cnt++;
+  return slab;
+}
+
+/* Returns the slab that OBJ, an object from CACHE, is in. */
+static struct slab *
+obj_to_slab (struct slab_cache *cache, void *obj) 
+{
+  struct slab *slab = pg_round_down (obj);
+
+  /* Check that the slab is valid. */
+  ASSERT (slab->magic == SLAB_MAGIC);
+  ASSERT (slab->cache == cache);
+  ASSERT ((uint8_t *) obj >= (uint8_t *) (slab + 1));
+
+  return slab;
+}
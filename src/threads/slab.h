@@ -0,0 +1,41 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Optional constructor, called on each object that slab_alloc()
+   is about to return. */
+typedef void slab_ctor (void *obj);
+
+/* A cache of equal-size objects, carved out of page-size
+   "slabs".  See slab.c for details. */
+struct slab_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    size_t color_cnt;           /* Number of distinct slab colors. */
+    size_t next_color;          /* Color of the next slab created. */
+    slab_ctor *ctor;            /* Constructor, or a null pointer. */
+    struct lock lock;           /* Protects the members below. */
+    struct list partial;        /* Slabs with free and used objects. */
+    struct list full;           /* Slabs with no free objects. */
+    struct list empty;          /* Slabs with no used objects. */
+    struct list_elem elem;      /* Element in list of all caches. */
+
+    /* Statistics. */
+    long long alloc_cnt;        /* Number of objects allocated. */
+    size_t slab_cnt;            /* Slabs currently owned. */
+    size_t used_cnt;            /* Objects currently in use. */
+    size_t max_used_cnt;        /* Most objects ever in use at once. */
+  };
+
+void slab_cache_init (struct slab_cache *, const char *name,
+                      size_t obj_size, slab_ctor *);
+void *slab_alloc (struct slab_cache *);
+void slab_free (struct slab_cache *, void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -0,0 +1,170 @@
+#include "threads/softirq.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Soft interrupts.
+
+   External interrupt handlers run with interrupts off, so any
+   work they do delays the timer and every other device.  A
+   handler can instead do only what must be done at once, such
+   as acknowledging the device, and raise a softirq for the rest,
+   such as waking up the thread that was waiting.
+
+   Raised softirqs are run by intr_handler() as soon as the
+   outermost external interrupt handler has returned, with
+   interrupts turned back on.  Like handlers, softirqs may not
+   sleep; intr_context() is true while they run, so a wakeup of a
+   higher-priority thread is deferred to intr_yield_on_return().
+   A softirq raised again before it runs is run only once, and
+   softirqs never run inside one another.
+
+   So that a flood of interrupts cannot starve threads, each run
+   handles at most SOFTIRQ_MAX_BATCH softirqs.  Any left over are
+   handed to the "softirqd" thread, which runs at PRI_MAX.  It
+   runs them under the same rules, and since no thread can have
+   a higher priority, it is not preempted until it is done. */
+
+/* Max number of softirqs to run on return from an interrupt. */
+#define SOFTIRQ_MAX_BATCH 16
+
+/* Softirqs raised and not yet run, in the order raised.
+   Accessed with interrupts off. */
+static struct list pending_list = LIST_INITIALIZER (pending_list);
+
+/* Wakes up softirqd, once it has been started. */
+static struct semaphore softirqd_wakeup;
+static bool softirqd_started;
+
+/* True while softirqs are running.  See softirq_running(). */
+static bool running;
+
+/* Statistics. */
+static long long raise_cnt;     /* # of softirqs raised. */
+static long long run_cnt;       /* # run on interrupt return. */
+static long long thread_run_cnt;/* # run by softirqd. */
+
+static bool run_batch (int max, long long *cnt);
+static thread_func softirqd;
+
+/* Initializes SIRQ to call FUNC with AUX whenever it is raised. */
+void
+softirq_init (struct softirq *sirq, softirq_func *func, void *aux)
+{
+  ASSERT (sirq != NULL);
+  ASSERT (func != NULL);
+
+  sirq->func = func;
+  sirq->aux = aux;
+  sirq->pending = false;
+}
+
+/* Raises SIRQ, so that it runs soon, unless it is already
+   pending.  Interrupts must be off. */
+void
+softirq_raise (struct softirq *sirq)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  raise_cnt++;
+  if (!sirq->pending)
+    {
+      sirq->pending = true;
+      list_push_back (&pending_list, &sirq->elem);
+    }
+}
+
+/* Returns true if any softirq has been raised and not yet run.
+   Interrupts must be off. */
+bool
+softirq_pending (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  return !list_empty (&pending_list);
+}
+
+/* Runs pending softirqs.  Called by intr_handler() with
+   interrupts off on return from an external interrupt; returns
+   with interrupts off, but turns them on while each softirq
+   runs. */
+void
+softirq_run (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!running);
+
+  running = true;
+  if (run_batch (softirqd_started ? SOFTIRQ_MAX_BATCH : -1, &run_cnt))
+    sema_up (&softirqd_wakeup);
+  running = false;
+}
+
+/* Returns true while softirqs are running, whether on return
+   from an interrupt or in softirqd. */
+bool
+softirq_running (void) 
+{
+  return running;
+}
+
+/* Starts the softirqd thread, which takes over softirqs that
+   cannot all be run on return from an interrupt. */
+void
+softirq_start (void)
+{
+  sema_init (&softirqd_wakeup, 0);
+  thread_create ("softirqd", PRI_MAX, softirqd, NULL);
+  softirqd_started = true;
+}
+
+/* Prints softirq statistics. */
+void
+softirq_print_stats (void)
+{
+  printf ("Softirq: %lld raised, %lld run on interrupt return, "
+          "%lld run by softirqd\n", raise_cnt, run_cnt, thread_run_cnt);
+}
+
+/* Runs up to MAX pending softirqs, or all of them if MAX is
+   negative, adding the number run to *CNT.  Must be called with
+   interrupts off, and returns with interrupts off.  Returns true
+   if softirqs remain pending. */
+static bool
+run_batch (int max, long long *cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&pending_list) && max-- != 0)
+    {
+      struct softirq *sirq = list_entry (list_pop_front (&pending_list),
+                                         struct softirq, elem);
+      sirq->pending = false;
+      ++*cnt;
+
+      intr_enable ();
+      sirq->func (sirq->aux);
+      intr_disable ();
+    }
+  return !list_empty (&pending_list);
+}
+
+/* Thread that runs softirqs left over by softirq_run(). */
+static void
+softirqd (void *aux UNUSED)
+{
+  for (;;)
+    {
+      enum intr_level old_level;
+
+      sema_down (&softirqd_wakeup);
+      old_level = intr_disable ();
+      ASSERT (!running);
+      running = true;
+      run_batch (-1, &thread_run_cnt);
+      running = false;
+      intr_set_level (old_level);
+    }
+}
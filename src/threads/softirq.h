@@ -0,0 +1,27 @@
+#ifndef THREADS_SOFTIRQ_H
+#define THREADS_SOFTIRQ_H
+
+#include <list.h>
+#include <stdbool.h>
+
+/* Deferred interrupt work ("soft interrupt").  An external
+   interrupt handler raises a softirq to have FUNC called with
+   AUX soon after the handler returns, with interrupts on. */
+typedef void softirq_func (void *aux);
+struct softirq
+  {
+    struct list_elem elem;      /* Element in pending list. */
+    softirq_func *func;         /* Function to call. */
+    void *aux;                  /* Argument for FUNC. */
+    bool pending;               /* Raised but not yet run? */
+  };
+
+void softirq_init (struct softirq *, softirq_func *, void *aux);
+void softirq_raise (struct softirq *);
+bool softirq_pending (void);
+void softirq_run (void);
+bool softirq_running (void);
+void softirq_start (void);
+void softirq_print_stats (void);
+
+#endif /* threads/softirq.h */
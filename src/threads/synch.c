@@ -30,7 +30,35 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
+#include "threads/schedtrace.h"
 #include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Arrival counter for waiters, which keeps waiters of equal
+   priority in FIFO order. */
+static unsigned next_wait_seq;
+
+/* Statistics. */
+static long long donation_cnt;  /* # of priority donations. */
+static int donation_max_depth;  /* Longest donation chain seen. */
+
+/* If false (default), named locks are not profiled.
+   If true, see struct lock_profile.
+   Controlled by kernel command-line option "-lockprof". */
+bool lock_profile;
+
+/* All named locks, for synch_print_stats(). */
+static struct list named_locks = LIST_INITIALIZER (named_locks);
+
+/* Readers-writer locks initialized with rwlock_init_named().
+   Accessed with interrupts off. */
+static struct list named_rwlocks = LIST_INITIALIZER (named_rwlocks);
+
+static void donate_priority (struct thread *donor);
+static void record_spins (struct lock *, unsigned spins, bool blocked);
+static void profile_acquire (struct lock *, int64_t start, bool contended);
+static heap_less_func waiter_less;
+static heap_less_func cond_waiter_less;
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -47,7 +75,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, waiter_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -68,7 +96,10 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+      cur->wait_seq = next_wait_seq++;
+      cur->waiting_sema = sema;
+      heap_push (&sema->waiters, &cur->waitelem);
       thread_block ();
     }
   sema->value--;
@@ -102,7 +133,9 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  If the woken thread has a higher priority than
+   the running thread, the running thread yields to it.
 
    This function may be called from an interrupt handler. */
 void
@@ -113,11 +146,44 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-  if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+  if (!heap_empty (&sema->waiters)) 
+    {
+      struct thread *t = heap_entry (heap_pop (&sema->waiters),
+                                     struct thread, waitelem);
+      t->waiting_sema = NULL;
+      thread_unblock (t);
+    }
   sema->value++;
   intr_set_level (old_level);
+  thread_yield_to_higher ();
+}
+
+/* Changes the priority of thread T, which must be waiting for
+   SEMA, to PRIORITY, and moves it to its new place among SEMA's
+   waiters.  Must be called with interrupts off. */
+void
+sema_reprioritize (struct semaphore *sema, struct thread *t, int priority) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  heap_remove (&sema->waiters, &t->waitelem);
+  t->priority = priority;
+  heap_push (&sema->waiters, &t->waitelem);
+}
+
+/* Returns true if waiting thread A should be woken after waiting
+   thread B: if it has a lower priority, or the same priority and
+   arrived later. */
+static bool
+waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+             void *aux UNUSED) 
+{
+  const struct thread *a = heap_entry (a_, struct thread, waitelem);
+  const struct thread *b = heap_entry (b_, struct thread, waitelem);
+
+  if (a->priority != b->priority)
+    return a->priority < b->priority;
+  return (int) (a->wait_seq - b->wait_seq) > 0;
 }
 
 static void sema_test_helper (void *sema_);
@@ -179,12 +245,59 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->max_spins = 0;
+  lock->name = NULL;
+}
+
+/* Initializes LOCK and names it NAME.  A named lock is listed by
+   synch_print_stats() and, with lock_profile on, keeps a profile
+   of how often and for how long it is contended and held. */
+void
+lock_init_named (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
+
+  ASSERT (lock != NULL);
+  ASSERT (name != NULL);
+
+  lock_init (lock);
+  lock->name = name;
+  memset (&lock->profile, 0, sizeof lock->profile);
+
+  old_level = intr_disable ();
+  list_push_back (&named_locks, &lock->stats_elem);
+  intr_set_level (old_level);
+}
+
+/* Initializes LOCK as an adaptive lock named NAME.  An adaptive
+   lock behaves like any other, except that a thread that finds
+   it held by a thread that is ready to run yields up to
+   MAX_SPINS times, donating its priority so that the holder
+   actually gets the CPU, before it blocks.  When critical
+   sections are short that usually saves blocking and being woken
+   up again.
+
+   A histogram of how many yields each acquisition took is kept
+   and printed by synch_print_stats(), which shows whether the
+   spinning pays off. */
+void
+lock_init_adaptive (struct lock *lock, const char *name, unsigned max_spins)
+{
+  lock_init_named (lock, name);
+  lock->max_spins = max_spins;
+  memset (lock->spin_hist, 0, sizeof lock->spin_hist);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   While we wait, our priority is donated to the holder of LOCK,
+   and from there along the chain of locks that each holder is
+   itself waiting for, up to LOCK_DONATION_DEPTH holders deep.
+   For an adaptive lock, we first yield to a ready holder a few
+   times before we block; see lock_init_adaptive().
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +305,110 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  unsigned spins = 0;
+  bool contended, blocked;
+  int64_t start = 0;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  contended = lock->holder != NULL;
+  if (lock_profile && lock->name != NULL && contended)
+    start = timer_ns ();
+  while (lock->holder != NULL && spins < lock->max_spins
+         && lock->holder->status == THREAD_READY)
+    {
+      if (!thread_mlfqs)
+        {
+          cur->waiting_lock = lock;
+          donate_priority (cur);
+        }
+      thread_yield ();
+      spins++;
+    }
+
+  blocked = lock->holder != NULL;
+  if (blocked && !thread_mlfqs)
+    {
+      cur->waiting_lock = lock;
+      donate_priority (cur);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+  if (lock->max_spins > 0)
+    record_spins (lock, spins, blocked);
+  if (lock_profile && lock->name != NULL)
+    profile_acquire (lock, start, contended);
+  intr_set_level (old_level);
+}
+
+/* Updates LOCK's profile for an acquisition that started waiting
+   at START, if CONTENDED is true.  Also marks the start of the
+   new holder's hold time. */
+static void
+profile_acquire (struct lock *lock, int64_t start, bool contended)
+{
+  struct lock_profile *p = &lock->profile;
+
+  p->acquired_ns = timer_ns ();
+  p->acquire_cnt++;
+  if (contended)
+    {
+      p->contended_cnt++;
+      p->wait_ns += p->acquired_ns - start;
+    }
+}
+
+/* Adds an acquisition of adaptive LOCK that took SPINS yields,
+   and then blocked if BLOCKED is true, to LOCK's histogram. */
+static void
+record_spins (struct lock *lock, unsigned spins, bool blocked)
+{
+  int bucket;
+
+  if (blocked)
+    bucket = LOCK_SPIN_BUCKETS - 1;
+  else
+    {
+      for (bucket = 0; spins > 0 && bucket < LOCK_SPIN_BUCKETS - 2; bucket++)
+        spins >>= 1;
+    }
+  lock->spin_hist[bucket]++;
+}
+
+/* Donates DONOR's priority to the holder of the lock DONOR is
+   waiting for, then to the holder of the lock that thread is
+   waiting for, and so on.  Stops early at a holder that already
+   has at least DONOR's priority, since everything further along
+   the chain then does too. */
+static void
+donate_priority (struct thread *donor)
+{
+  struct lock *lock = donor->waiting_lock;
+  int depth = 0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (lock != NULL && lock->holder != NULL
+         && depth < LOCK_DONATION_DEPTH)
+    {
+      struct thread *holder = lock->holder;
+      if (holder->priority >= donor->priority)
+        break;
+      thread_donate_priority (holder, donor->priority);
+      schedtrace_record (SCHED_DONATE, holder->tid, donor->priority);
+      donation_cnt++;
+      depth++;
+      lock = holder->waiting_lock;
+    }
+  if (depth > donation_max_depth)
+    donation_max_depth = depth;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,11 +427,21 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      enum intr_level old_level = intr_disable ();
+      lock->holder = thread_current ();
+      list_push_back (&lock->holder->held_locks, &lock->elem);
+      if (lock_profile && lock->name != NULL)
+        profile_acquire (lock, 0, false);
+      intr_set_level (old_level);
+    }
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Any priority donated to us through LOCK is given up, so our
+   priority drops back to the highest of our base priority and
+   the donations still coming in through other locks we hold.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,10 +449,25 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock_profile && lock->name != NULL)
+    {
+      struct lock_profile *p = &lock->profile;
+      int64_t held = timer_ns () - p->acquired_ns;
+      if (held > p->max_hold_ns)
+        p->max_hold_ns = held;
+    }
+  list_remove (&lock->elem);
   lock->holder = NULL;
+  if (!thread_mlfqs)
+    thread_refresh_priority (cur);
+  intr_set_level (old_level);
   sema_up (&lock->semaphore);
 }
 
@@ -246,11 +482,65 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
+/* Prints priority donation statistics, the contention
+   histograms of adaptive locks and, with lock_profile on, the
+   profiles of named locks. */
+void
+synch_print_stats (void) 
+{
+  struct list_elem *e;
+
+  printf ("Synch: %lld priority donations, longest chain %d\n",
+          donation_cnt, donation_max_depth);
+
+  if (lock_profile)
+    {
+      printf ("%-16s %10s %10s %12s %12s\n",
+              "Lock", "acquired", "contended", "wait (us)", "max hold (us)");
+      for (e = list_begin (&named_locks); e != list_end (&named_locks);
+           e = list_next (e))
+        {
+          struct lock *lock = list_entry (e, struct lock, stats_elem);
+          struct lock_profile *p = &lock->profile;
+
+          printf ("%-16s %10llu %10llu %12lld %12lld\n", lock->name,
+                  p->acquire_cnt, p->contended_cnt,
+                  p->wait_ns / 1000, p->max_hold_ns / 1000);
+        }
+    }
+
+  for (e = list_begin (&named_locks); e != list_end (&named_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, stats_elem);
+      int i;
+
+      if (lock->max_spins == 0)
+        continue;
+      printf ("Adaptive lock %s: %u free,", lock->name, lock->spin_hist[0]);
+      for (i = 1; i < LOCK_SPIN_BUCKETS - 2; i++)
+        printf (" %u after <%u yields,", lock->spin_hist[i], 1u << i);
+      printf (" %u after >=%u yields,", lock->spin_hist[i], 1u << (i - 1));
+      printf (" %u blocked\n", lock->spin_hist[LOCK_SPIN_BUCKETS - 1]);
+    }
+
+  for (e = list_begin (&named_rwlocks); e != list_end (&named_rwlocks);
+       e = list_next (e))
+    {
+      struct rwlock *rwlock = list_entry (e, struct rwlock, stats_elem);
+      printf ("Rwlock %s: %llu readers blocked by writers\n", rwlock->name,
+              rwlock_blocked_readers (rwlock));
+    }
+}
+
+/* One semaphore in a condition variable's waiter heap.  The
+   waiting thread's priority is recorded when it starts to wait. */
 struct semaphore_elem 
   {
-    struct list_elem elem;              /* List element. */
+    struct heap_elem elem;              /* Heap element. */
     struct semaphore semaphore;         /* This semaphore. */
+    int priority;                       /* Waiting thread's priority. */
+    unsigned seq;                       /* Arrival order. */
   };
 
 /* Initializes condition variable COND.  A condition variable
@@ -261,7 +551,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, cond_waiter_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -295,14 +585,17 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
+  waiter.priority = thread_current ()->priority;
+  waiter.seq = next_wait_seq++;
+  heap_push (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the one with the highest priority to
+   wake up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -316,8 +609,8 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
+  if (!heap_empty (&cond->waiters)) 
+    sema_up (&heap_entry (heap_pop (&cond->waiters),
                           struct semaphore_elem, elem)->semaphore);
 }
 
@@ -333,6 +626,254 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!heap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes readers-writer lock RWLOCK, which is initially
+   not held by anyone. */
+void
+rwlock_init (struct rwlock *rwlock) 
+{
+  ASSERT (rwlock != NULL);
+
+  rwlock->readers = 0;
+  rwlock->writing = false;
+  rwlock->writer = NULL;
+  rwlock->waiting_readers = 0;
+  rwlock->waiting_writers = 0;
+  sema_init (&rwlock->read_sema, 0);
+  sema_init (&rwlock->write_sema, 0);
+  rwlock->blocked_reader_cnt = 0;
+  rwlock->name = NULL;
+}
+
+/* Initializes RWLOCK and names it NAME.  A named rwlock is
+   listed by synch_print_stats() with the number of readers that
+   had to wait for a writer. */
+void
+rwlock_init_named (struct rwlock *rwlock, const char *name) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (name != NULL);
+
+  rwlock_init (rwlock);
+  rwlock->name = name;
+
+  old_level = intr_disable ();
+  list_push_back (&named_rwlocks, &rwlock->stats_elem);
+  intr_set_level (old_level);
+}
+
+/* Acquires RWLOCK for reading, sleeping while a writer holds it
+   or is waiting for it.
+
+   Ownership is handed over by the releasing thread, which counts
+   us as a reader before it wakes us, so when sema_down() returns
+   we already hold the lock.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rwlock) 
+{
+  enum intr_level old_level;
+  bool wait;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rwlock->writer != thread_current ());
+
+  old_level = intr_disable ();
+  wait = rwlock->writing || rwlock->waiting_writers > 0;
+  if (wait)
+    {
+      rwlock->waiting_readers++;
+      rwlock->blocked_reader_cnt++;
+    }
+  else
+    rwlock->readers++;
+  intr_set_level (old_level);
+
+  if (wait)
+    sema_down (&rwlock->read_sema);
+}
+
+/* Tries to acquire RWLOCK for reading without sleeping.  Returns
+   true if successful, false if a writer holds the lock or is
+   waiting for it.
+
+   This function will not sleep, so it may be called within an
+   interrupt handler. */
+bool
+rwlock_try_acquire_read (struct rwlock *rwlock) 
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (rwlock != NULL);
+
+  old_level = intr_disable ();
+  success = !rwlock->writing && rwlock->waiting_writers == 0;
+  if (success)
+    rwlock->readers++;
+  intr_set_level (old_level);
+
+  return success;
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+   reading.  The last reader out hands the lock to a waiting
+   writer, if there is one. */
+void
+rwlock_release_read (struct rwlock *rwlock) 
+{
+  enum intr_level old_level;
+  bool wake_writer = false;
+
+  ASSERT (rwlock != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (rwlock->readers > 0);
+  if (--rwlock->readers == 0 && rwlock->waiting_writers > 0)
+    {
+      rwlock->waiting_writers--;
+      rwlock->writing = true;
+      wake_writer = true;
+    }
+  intr_set_level (old_level);
+
+  if (wake_writer)
+    sema_up (&rwlock->write_sema);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no reader or
+   writer holds it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rwlock) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool wait;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rwlock->writer != cur);
+
+  old_level = intr_disable ();
+  wait = rwlock->writing || rwlock->readers > 0;
+  if (wait)
+    rwlock->waiting_writers++;
+  else
+    rwlock->writing = true;
+  intr_set_level (old_level);
+
+  if (wait)
+    sema_down (&rwlock->write_sema);
+  rwlock->writer = cur;
+}
+
+/* Tries to acquire RWLOCK for writing without sleeping.  Returns
+   true if successful, false if anyone holds the lock.
+
+   This function will not sleep, so it may be called within an
+   interrupt handler. */
+bool
+rwlock_try_acquire_write (struct rwlock *rwlock) 
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (rwlock != NULL);
+
+  old_level = intr_disable ();
+  success = !rwlock->writing && rwlock->readers == 0;
+  if (success)
+    {
+      rwlock->writing = true;
+      rwlock->writer = thread_current ();
+    }
+  intr_set_level (old_level);
+
+  return success;
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+   writing.  If readers queued up while we held the lock, all of
+   them are admitted; otherwise the lock is handed to the next
+   waiting writer, if any. */
+void
+rwlock_release_write (struct rwlock *rwlock) 
+{
+  enum intr_level old_level;
+  unsigned wake_readers = 0;
+  bool wake_writer = false;
+
+  ASSERT (rwlock != NULL);
+  ASSERT (rwlock_held_for_write (rwlock));
+
+  old_level = intr_disable ();
+  rwlock->writer = NULL;
+  if (rwlock->waiting_readers > 0)
+    {
+      wake_readers = rwlock->waiting_readers;
+      rwlock->readers += wake_readers;
+      rwlock->waiting_readers = 0;
+      rwlock->writing = false;
+    }
+  else if (rwlock->waiting_writers > 0)
+    {
+      /* Stay in writing mode for the writer we wake. */
+      rwlock->waiting_writers--;
+      wake_writer = true;
+    }
+  else
+    rwlock->writing = false;
+  intr_set_level (old_level);
+
+  while (wake_readers-- > 0)
+    sema_up (&rwlock->read_sema);
+  if (wake_writer)
+    sema_up (&rwlock->write_sema);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing,
+   false otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rwlock) 
+{
+  ASSERT (rwlock != NULL);
+
+  return rwlock->writer == thread_current ();
+}
+
+/* Returns the number of times a reader had to wait for RWLOCK
+   because a writer held it or was waiting for it. */
+unsigned long long
+rwlock_blocked_readers (const struct rwlock *rwlock) 
+{
+  ASSERT (rwlock != NULL);
+
+  return rwlock->blocked_reader_cnt;
+}
+
+/* Returns true if condition variable waiter A should be
+   signaled after waiter B. */
+static bool
+cond_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED) 
+{
+  const struct semaphore_elem *a = heap_entry (a_, struct semaphore_elem,
+                                               elem);
+  const struct semaphore_elem *b = heap_entry (b_, struct semaphore_elem,
+                                               elem);
+
+  if (a->priority != b->priority)
+    return a->priority < b->priority;
+  return (int) (a->seq - b->seq) > 0;
+}
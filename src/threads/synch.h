@@ -1,39 +1,90 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
-/* A counting semaphore. */
+struct thread;
+
+/* A counting semaphore.  Waiting threads are kept in a heap
+   ordered by priority, FIFO among equal priorities. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Heap of waiting threads. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
+void sema_reprioritize (struct semaphore *, struct thread *, int priority);
 void sema_self_test (void);
 
+/* Number of buckets in an adaptive lock's contention histogram.
+   Bucket 0 counts acquisitions that found the lock free, bucket
+   I for 0 < I < LOCK_SPIN_BUCKETS - 1 those that got it after
+   2**(I-1) to 2**I - 1 yields (bucket LOCK_SPIN_BUCKETS - 2 also
+   takes any more), and the last bucket those that had to block. */
+#define LOCK_SPIN_BUCKETS 6
+
+/* Number of yields an adaptive lock makes before blocking, when
+   the caller has no better idea. */
+#define LOCK_ADAPTIVE_SPINS 4
+
+/* Contention profile of a named lock, kept while lock_profile
+   is true. */
+struct lock_profile
+  {
+    unsigned long long acquire_cnt;   /* # of acquisitions. */
+    unsigned long long contended_cnt; /* # that found the lock held. */
+    int64_t wait_ns;            /* Total time spent waiting. */
+    int64_t max_hold_ns;        /* Longest time the lock was held. */
+    int64_t acquired_ns;        /* When the current holder acquired it. */
+  };
+
+/* If false (default), named locks are not profiled.  If true,
+   lock_acquire() and lock_release() keep a lock_profile for each
+   named lock, printed by synch_print_stats().
+   Controlled by kernel command-line option "-lockprof". */
+extern bool lock_profile;
+
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks list. */
+
+    /* Named locks only; see lock_init_named(). */
+    const char *name;           /* Name, for statistics. */
+    struct list_elem stats_elem;/* Element in list of named locks. */
+    struct lock_profile profile;/* Contention profile. */
+
+    /* Adaptive locks only; see lock_init_adaptive(). */
+    unsigned max_spins;         /* Yields before blocking, 0 if not adaptive. */
+    unsigned spin_hist[LOCK_SPIN_BUCKETS]; /* Contention histogram. */
   };
 
+/* Maximum number of lock holders that one lock_acquire() donates
+   its priority through, following each holder's waiting_lock. */
+#define LOCK_DONATION_DEPTH 8
+
 void lock_init (struct lock *);
+void lock_init_named (struct lock *, const char *name);
+void lock_init_adaptive (struct lock *, const char *name, unsigned max_spins);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void synch_print_stats (void);
 
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Heap of waiting threads' semaphores. */
   };
 
 void cond_init (struct condition *);
@@ -41,6 +92,41 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.
+
+   Any number of readers may hold the lock at once, or a single
+   writer.  Once a writer is waiting, newly arriving readers wait
+   behind it, so that writers are not starved by a steady stream
+   of readers; when a writer releases the lock, all the readers
+   that queued up in the meantime are admitted together before
+   the next writer, so readers are not starved either. */
+struct rwlock 
+  {
+    unsigned readers;           /* Number of readers holding the lock. */
+    bool writing;               /* Held, or being handed, to a writer? */
+    struct thread *writer;      /* Writer holding the lock (for debugging). */
+    unsigned waiting_readers;   /* Number of readers waiting. */
+    unsigned waiting_writers;   /* Number of writers waiting. */
+    struct semaphore read_sema; /* Readers wait here. */
+    struct semaphore write_sema;/* Writers wait here. */
+    unsigned long long blocked_reader_cnt; /* # of readers that waited. */
+
+    /* Named rwlocks only; see rwlock_init_named(). */
+    const char *name;           /* Name, for statistics. */
+    struct list_elem stats_elem;/* Element in list of named rwlocks. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_init_named (struct rwlock *, const char *name);
+void rwlock_acquire_read (struct rwlock *);
+bool rwlock_try_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+bool rwlock_try_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+unsigned long long rwlock_blocked_readers (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -1,17 +1,22 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <limits.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/schedtrace.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -21,13 +26,56 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queues of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO queue per priority level, and bit P of
+   ready_mask is set exactly when ready_queues[P] is non-empty, so
+   that the highest ready priority can be found with a single
+   bit scan instead of a walk over all ready threads. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+static struct list ready_queues[PRI_CNT];
+static uint64_t ready_mask;
+static int ready_cnt;           /* # of threads in the run queues. */
+
+/* Earliest-deadline-first real-time class.
+
+   A real-time thread is given a period and a budget, both in
+   timer ticks, and may use up to its budget of CPU time in each
+   period.  The deadline of each period's job is the end of the
+   period.  While a real-time thread has budget left in its
+   current period, it waits in rt_queue, ordered by deadline,
+   instead of in the priority run queues, and any thread in
+   rt_queue runs before any thread in those.  A real-time thread
+   that has used up its budget competes in its priority's run
+   queue until its next period begins.
+
+   thread_set_realtime() admits a thread only if the total
+   utilization, the sum of budget / period over all real-time
+   threads, stays within RT_UTIL_MAX thousandths, which keeps the
+   class schedulable and leaves some CPU to everyone else.
+
+   A real-time thread ends each job by calling
+   thread_rt_wait_period(), which blocks until the next period.
+   thread_tick() counts a deadline miss whenever a period ends
+   before its job did. */
+static struct heap rt_queue;    /* Ready real-time threads. */
+static struct list rt_threads;  /* All real-time threads. */
+static int rt_util;             /* Total utilization, in thousandths. */
 
 /* List of all processes.  Processes are added to this list
-   when they are first scheduled and removed when they exit. */
+   when they are first scheduled and removed when they exit.
+   Changes are made holding all_list_lock for writing and with
+   interrupts off, so that the list may be walked either holding
+   all_list_lock for reading or with interrupts off. */
 static struct list all_list;
+static struct rwlock all_list_lock;
+
+/* Index of all_list by tid, for get_thread().  Changes are made
+   holding all_list_lock for writing, lookups holding it for
+   reading.  Since hash tables are allocated with malloc(), which
+   is not yet available in thread_init(), the table is created by
+   thread_start(). */
+static struct hash tid_table;
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -46,15 +94,33 @@ struct kernel_thread_frame
   void *aux;                  /* Auxiliary data for function. */
 };
 
+/* Pages of threads that have exited, kept for reuse by
+   thread_create() so that a create/exit cycle need not go
+   through the page allocator.  Each page's first word points to
+   the next cached page.  Accessed with interrupts off. */
+#define THREAD_CACHE_MAX 16     /* Max # of pages in the cache. */
+static void *thread_cache;      /* Most recently cached page. */
+static size_t thread_cache_cnt; /* # of pages in the cache. */
+
 /* Statistics. */
+static long long rt_miss_cnt;   /* # of real-time deadline misses. */
+static long long thread_cache_hits;   /* # of pages reused. */
+static long long thread_cache_misses; /* # of pages from palloc. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
 /* Scheduling. */
-#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* Time slice of the initial thread.  See thread.h.
+   Controlled by kernel command-line option "-slice=TICKS". */
+unsigned thread_time_slice = TIME_SLICE_DEFAULT;
+
+/* Multi-level feedback queue scheduling. */
+#define MLFQS_PRI_INTERVAL 4    /* # of timer ticks between priority updates. */
+static fixed_point load_avg;    /* Estimated # of threads ready to run. */
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
@@ -66,8 +132,25 @@ static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
+static thread_action_func print_thread_stats;
+static struct thread *get_thread_locked (tid_t);
+static hash_hash_func tid_hash;
+static hash_less_func tid_less;
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
+static void ready_queue_push (struct thread *);
+static bool ready_queue_has_higher (struct thread *);
+static heap_less_func rt_deadline_later;
+static void rt_start_periods (int64_t now);
+static struct thread *ready_queue_pop (void);
+static void ready_queue_remove (struct thread *);
+static void set_effective_priority (struct thread *, int);
+static void mlfqs_update_load_avg (void);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
+static void mlfqs_update_priority (struct thread *, void *aux);
+static int ready_queue_max_priority (void);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
@@ -88,15 +171,25 @@ static tid_t allocate_tid (void);
   void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
+  lock_init_named (&tid_lock, "tid");
+  for (i = 0; i < PRI_CNT; i++)
+    list_init (&ready_queues[i]);
+  ready_mask = 0;
+  ready_cnt = 0;
+  heap_init (&rt_queue, rt_deadline_later, NULL);
+  list_init (&rt_threads);
+  load_avg = fp_from_int (0);
   list_init (&all_list);
+  rwlock_init_named (&all_list_lock, "all_list");
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
+  list_push_back (&all_list, &initial_thread->allelem);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
 }
@@ -106,8 +199,14 @@ thread_init (void)
   void
 thread_start (void) 
 {
-  /* Create the idle thread. */
   struct semaphore idle_started;
+
+  /* Index the initial thread by tid. */
+  if (!hash_init (&tid_table, tid_hash, tid_less, NULL))
+    PANIC ("out of memory for tid table");
+  hash_insert (&tid_table, &initial_thread->tidelem);
+
+  /* Create the idle thread. */
   sema_init (&idle_started, 0);
   thread_create ("idle", PRI_MIN, idle, &idle_started);
 
@@ -130,22 +229,92 @@ thread_tick (void)
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
+  {
     user_ticks++;
+    t->user_ticks++;
+  }
 #endif
   else
+  {
     kernel_ticks++;
+    t->kernel_ticks++;
+  }
+
+  if (thread_mlfqs)
+  {
+    int64_t now = timer_ticks ();
+
+    /* Only the running thread's recent_cpu changes between the
+       once-per-second updates, so only its priority needs to be
+       recomputed on the other priority-update ticks. */
+    if (t != idle_thread)
+      t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+    if (now % TIMER_FREQ == 0)
+    {
+      mlfqs_update_load_avg ();
+      thread_foreach (mlfqs_update_recent_cpu, NULL);
+    }
+    if (now % MLFQS_PRI_INTERVAL == 0)
+    {
+      if (now % TIMER_FREQ == 0)
+        thread_foreach (mlfqs_update_priority, NULL);
+      else if (t != idle_thread)
+        mlfqs_update_priority (t, NULL);
+      thread_yield_to_higher ();
+    }
+  }
+
+  /* Charge real-time threads for their CPU time, and start the
+     periods that are due. */
+  if (t->rt_period != 0 && ++t->rt_used == t->rt_budget)
+    intr_yield_on_return ();
+  if (!list_empty (&rt_threads))
+    rt_start_periods (timer_ticks ());
 
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++thread_ticks >= t->time_slice)
+  {
+    schedtrace_record (SCHED_PREEMPT, t->tid, 1);
     intr_yield_on_return ();
+  }
+}
+
+/* Accounts for N timer ticks that the idle thread spent with the
+   periodic timer interrupt stopped.  See timer_idle_enter(). */
+  void
+thread_skip_idle_ticks (int64_t n)
+{
+  idle_ticks += n;
 }
 
 /* Prints thread statistics. */
   void
 thread_print_stats (void) 
 {
+  enum intr_level old_level;
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
       idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld pages reused, %lld allocated\n",
+      thread_cache_hits, thread_cache_misses);
+  printf ("Thread: %lld real-time deadline misses\n", rt_miss_cnt);
+
+  old_level = intr_disable ();
+  printf ("%5s %-16s %10s %10s %10s %10s %12s\n", "tid", "name",
+      "user", "kernel", "vol csw", "invol csw", "ready (us)");
+  thread_foreach (print_thread_stats, NULL);
+  intr_set_level (old_level);
+}
+
+/* Prints the CPU accounting of thread T.  An involuntary switch
+   is one where T was still runnable, because it was preempted or
+   yielded; a voluntary one is where T blocked or exited. */
+  static void
+print_thread_stats (struct thread *t, void *aux UNUSED) 
+{
+  printf ("%5d %-16s %10lld %10lld %10u %10u %12lld\n", t->tid, t->name,
+      t->user_ticks, t->kernel_ticks, t->voluntary_switches,
+      t->involuntary_switches, t->ready_wait_ns / 1000);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -160,9 +329,9 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, the running thread yields to it before this function
+   returns. */
   tid_t
 thread_create (const char *name, int priority,
     thread_func *function, void *aux) 
@@ -177,7 +346,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -185,6 +354,13 @@ thread_create (const char *name, int priority,
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
 
+  rwlock_acquire_write (&all_list_lock);
+  hash_insert (&tid_table, &t->tidelem);
+  old_level = intr_disable ();
+  list_push_back (&all_list, &t->allelem);
+  intr_set_level (old_level);
+  rwlock_release_write (&all_list_lock);
+
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
@@ -218,6 +394,7 @@ thread_create (const char *name, int priority,
 
   /* Add to run queue. */
   thread_unblock (t);
+  thread_yield_to_higher ();
 
   return tid;
 }
@@ -235,6 +412,7 @@ thread_block (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   thread_current ()->status = THREAD_BLOCKED;
+  schedtrace_record (SCHED_BLOCK, thread_current ()->tid, 0);
   schedule ();
 }
 
@@ -255,8 +433,11 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_queue_push (t);
   t->status = THREAD_READY;
+  t->ready_ns = timer_ns ();
+  schedtrace_record (SCHED_WAKEUP, t->tid,
+                     intr_context () ? 0 : thread_current ()->tid);
   intr_set_level (old_level);
 }
 
@@ -293,6 +474,46 @@ thread_tid (void)
   return thread_current ()->tid;
 }
 
+/* A thread waiting in thread_join(). */
+struct joiner
+  {
+    struct list_elem elem;      /* Element in joined thread's joiners. */
+    struct semaphore exited;    /* Upped when the thread exits. */
+  };
+
+/* Waits for the thread with the given TID to exit.  Returns
+   immediately if there is no such thread, because it has
+   already exited or never existed.  Any number of threads may
+   join the same thread.
+
+   The thread's tid_table entry is removed, and its joiners
+   woken, with all_list_lock held for writing, so holding the
+   lock for reading while we register ensures that the thread
+   cannot exit in between without waking us. */
+  void
+thread_join (tid_t tid) 
+{
+  struct joiner joiner;
+  struct thread *t;
+
+  ASSERT (!intr_context ());
+  ASSERT (tid != thread_tid ());
+
+  sema_init (&joiner.exited, 0);
+  rwlock_acquire_read (&all_list_lock);
+  t = get_thread_locked (tid);
+  if (t != NULL)
+    {
+      enum intr_level old_level = intr_disable ();
+      list_push_back (&t->joiners, &joiner.elem);
+      intr_set_level (old_level);
+    }
+  rwlock_release_read (&all_list_lock);
+
+  if (t != NULL)
+    sema_down (&joiner.exited);
+}
+
 /* Deschedules the current thread and destroys it.  Never
    returns to the caller. */
   void
@@ -303,14 +524,27 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
+  if (thread_current ()->rt_period != 0)
+    thread_clear_realtime ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
+  rwlock_acquire_write (&all_list_lock);
+  hash_delete (&tid_table, &thread_current ()->tidelem);
   intr_disable ();
   // printf("thread_remove\n");
   list_remove (&thread_current()->allelem);
+  while (!list_empty (&thread_current ()->joiners))
+  {
+    struct list_elem *e = list_pop_front (&thread_current ()->joiners);
+    sema_up (&list_entry (e, struct joiner, elem)->exited);
+  }
+  rwlock_release_write (&all_list_lock);
+#ifdef USERPROG
   sema_up(&thread_current()->waitsema);
+#endif
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -328,33 +562,87 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_queue_push (cur);
   cur->status = THREAD_READY;
+  cur->ready_ns = timer_ns ();
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if some ready thread has a higher priority than
+   the running thread.  Within an interrupt handler the yield is
+   deferred until the handler returns.  Outside one, nothing
+   happens while interrupts are off, so that callers that
+   disabled interrupts keep their atomicity. */
+  void
+thread_yield_to_higher (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool preempt = (running_thread () != idle_thread
+                  ? ready_queue_has_higher (thread_current ())
+                  : ready_cnt != 0);
+
+  if (preempt && (intr_context () || old_level == INTR_ON))
+    schedtrace_record (SCHED_PREEMPT, running_thread ()->tid, 0);
+  intr_set_level (old_level);
+  if (!preempt)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else if (old_level == INTR_ON)
+    thread_yield ();
+}
+
 /*  When given tid, this function returns corresponding thread pointer
     for that tid*/
   struct thread*
 get_thread(tid_t tid_)
 {
-  struct list_elem *e;
+  struct thread *ret;
 
-  for(e = list_begin (&all_list); e != list_end(&all_list);
-      e = list_next (e))
+  rwlock_acquire_read (&all_list_lock);
+  ret = get_thread_locked (tid_);
+  rwlock_release_read (&all_list_lock);
+  return ret;
+}
+
+/* Returns the thread with the given TID, or a null pointer if
+   there is none.  The caller must hold all_list_lock. */
+  static struct thread *
+get_thread_locked (tid_t tid) 
+{
+  struct thread key;
+  struct hash_elem *e;
+
+  key.tid = tid;
+  e = hash_find (&tid_table, &key.tidelem);
+  if (e != NULL)
   {
-    struct thread* ret = list_entry (e, struct thread, allelem);
-    if(ret->tid == tid_)
-    {
-      if(ret->status == THREAD_DYING)
-        return NULL;
-      return ret;
-    }
+    struct thread *t = hash_entry (e, struct thread, tidelem);
+    if (t->status != THREAD_DYING)
+      return t;
   }
   return NULL;
 }
 
+/* Returns a hash value for thread T in tid_table. */
+  static unsigned
+tid_hash (const struct hash_elem *t_, void *aux UNUSED) 
+{
+  const struct thread *t = hash_entry (t_, struct thread, tidelem);
+  return hash_int (t->tid);
+}
+
+/* Returns true if thread A precedes thread B in tid_table. */
+  static bool
+tid_less (const struct hash_elem *a_, const struct hash_elem *b_,
+          void *aux UNUSED) 
+{
+  const struct thread *a = hash_entry (a_, struct thread, tidelem);
+  const struct thread *b = hash_entry (b_, struct thread, tidelem);
+  return a->tid < b->tid;
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
   void
@@ -372,11 +660,93 @@ thread_foreach (thread_action_func *func, void *aux)
   }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.  The
+   effective priority stays higher while some other thread is
+   donating to us. */
   void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The MLFQS scheduler computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_refresh_priority (cur);
+  intr_set_level (old_level);
+  thread_yield_to_higher ();
+}
+
+/* Raises thread T's effective priority to PRIORITY on behalf of
+   a thread waiting for a lock that T holds.  Does nothing if T
+   already runs at PRIORITY or higher.  Must be called with
+   interrupts off. */
+  void
+thread_donate_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (is_thread (t));
+
+  if (priority > t->priority)
+    set_effective_priority (t, priority);
+}
+
+/* Recomputes thread T's effective priority as the maximum of its
+   base priority and the priorities of all threads waiting for
+   locks that T holds.  Must be called with interrupts off. */
+  void
+thread_refresh_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (is_thread (t));
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+      e = list_next (e))
+  {
+    struct lock *lock = list_entry (e, struct lock, elem);
+    struct heap *waiters = &lock->semaphore.waiters;
+
+    /* The waiter heap is ordered by priority, so its top is the
+       highest priority waiting for LOCK. */
+    if (!heap_empty (waiters))
+    {
+      struct thread *waiter = heap_entry (heap_max (waiters),
+          struct thread, waitelem);
+      if (waiter->priority > priority)
+        priority = waiter->priority;
+    }
+  }
+  set_effective_priority (t, priority);
+}
+
+/* Sets thread T's effective priority to PRIORITY, moving T to
+   the matching run queue if it is ready, or to its new place
+   among a semaphore's waiters if it is waiting for one. */
+  static void
+set_effective_priority (struct thread *t, int priority)
+{
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY)
+  {
+    ready_queue_remove (t);
+    t->priority = priority;
+    ready_queue_push (t);
+  }
+  else if (t->status == THREAD_BLOCKED && t->waiting_sema != NULL)
+    sema_reprioritize (t->waiting_sema, t, priority);
+  else
+    t->priority = priority;
 }
 
 /* Returns the current thread's priority. */
@@ -386,47 +756,220 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest. */
   void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur, NULL);
+  intr_set_level (old_level);
+  thread_yield_to_higher ();
 }
 
 /* Returns the current thread's nice value. */
   int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
+}
+
+/* Sets the current thread's time slice to TICKS timer ticks.
+   Takes effect at the next timer tick, so a thread that has
+   already run for TICKS or more is preempted then. */
+  void
+thread_set_time_slice (unsigned ticks) 
+{
+  ASSERT (ticks > 0);
+
+  thread_current ()->time_slice = ticks;
+}
+
+/* Returns the current thread's time slice, in timer ticks. */
+  unsigned
+thread_get_time_slice (void) 
+{
+  return thread_current ()->time_slice;
+}
+
+/* Makes the running thread a real-time thread that may use
+   BUDGET timer ticks of CPU time in every PERIOD ticks, starting
+   with a period that begins now.  Returns false, without
+   changing anything, if admitting it would raise the total
+   real-time utilization above RT_UTIL_MAX. */
+  bool
+thread_set_realtime (int period, int budget) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int util, old_util;
+  bool success;
+
+  ASSERT (0 < budget && budget <= period);
+  ASSERT (period <= INT_MAX / 1000);
+
+  util = DIV_ROUND_UP (budget * 1000, period);
+  old_level = intr_disable ();
+  old_util = (cur->rt_period != 0
+              ? DIV_ROUND_UP (cur->rt_budget * 1000, cur->rt_period) : 0);
+  success = rt_util - old_util + util <= RT_UTIL_MAX;
+  if (success)
+  {
+    rt_util += util - old_util;
+    if (cur->rt_period == 0)
+      list_push_back (&rt_threads, &cur->rt_allelem);
+    cur->rt_period = period;
+    cur->rt_budget = budget;
+    cur->rt_deadline = timer_ticks () + period;
+    cur->rt_used = 0;
+    cur->rt_done = false;
+  }
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Returns the running thread to the normal scheduling classes. */
+  void
+thread_clear_realtime (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (cur->rt_period != 0);
+
+  old_level = intr_disable ();
+  rt_util -= DIV_ROUND_UP (cur->rt_budget * 1000, cur->rt_period);
+  list_remove (&cur->rt_allelem);
+  cur->rt_period = 0;
+  intr_set_level (old_level);
+  thread_yield_to_higher ();
+}
+
+/* Ends the running real-time thread's job for its current
+   period, and sleeps until its next period begins. */
+  void
+thread_rt_wait_period (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+  ASSERT (cur->rt_period != 0);
+
+  old_level = intr_disable ();
+  cur->rt_done = true;
+  cur->rt_waiting = true;
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Returns the tick at which the next real-time period begins, or
+   INT64_MAX if there are no real-time threads.  Used by the timer
+   to avoid sleeping through a period in tickless idle. */
+  int64_t
+thread_rt_next_deadline (void) 
+{
+  struct list_elem *e;
+  int64_t next = INT64_MAX;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&rt_threads); e != list_end (&rt_threads);
+       e = list_next (e))
+  {
+    struct thread *t = list_entry (e, struct thread, rt_allelem);
+    if (t->rt_deadline < next)
+      next = t->rt_deadline;
+  }
+  return next;
 }
 
 /* Returns 100 times the system load average. */
   int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
   int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent;
+}
+
+/* Updates the system load average once per second:
+   load_avg = (59/60) * load_avg + (1/60) * ready_threads,
+   where ready_threads counts the running thread unless it is
+   the idle thread. */
+  static void
+mlfqs_update_load_avg (void)
+{
+  int ready_threads = ready_cnt;
+
+  if (running_thread () != idle_thread)
+    ready_threads++;
+  load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+                     fp_div_int (fp_from_int (ready_threads), 60));
+}
+
+/* Decays thread T's recent_cpu once per second:
+   recent_cpu = (2 * load_avg) / (2 * load_avg + 1) * recent_cpu + nice.
+   For use with thread_foreach(). */
+  static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+  fixed_point twice_load = fp_mul_int (load_avg, 2);
+  fixed_point decay = fp_div (twice_load, fp_add_int (twice_load, 1));
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (decay, t->recent_cpu), t->nice);
+}
+
+/* Recomputes thread T's priority:
+   priority = PRI_MAX - (recent_cpu / 4) - (nice * 2),
+   clamped to PRI_MIN..PRI_MAX.  For use with thread_foreach(). */
+  static void
+mlfqs_update_priority (struct thread *t, void *aux UNUSED)
+{
+  int priority;
+
+  if (t == idle_thread)
+    return;
+  priority = PRI_MAX - fp_to_int (fp_div_int (t->recent_cpu, 4))
+             - t->nice * 2;
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  t->base_priority = priority;
+  set_effective_priority (t, priority);
 }
 
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
+   The idle thread is initially put on a run queue by
    thread_start().  It will be scheduled once initially, at which
    point it initializes idle_thread, "up"s the semaphore passed
    to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   blocks.  After that, the idle thread never appears in a run
+   queue.  It is returned by next_thread_to_run() as a special
+   case when every run queue is empty. */
   static void
 idle (void *idle_started_ UNUSED) 
 {
@@ -440,6 +983,20 @@ idle (void *idle_started_ UNUSED)
     intr_disable ();
     thread_block ();
 
+    /* Zero free pages for later PAL_ZERO requests until there
+       are enough or another thread becomes ready. */
+    intr_enable ();
+    while (palloc_zero_idle ())
+      if (ready_cnt != 0)
+        break;
+    intr_disable ();
+    if (ready_cnt != 0)
+      continue;
+
+    /* In tickless mode, stop the periodic timer interrupt until
+       the next sleeper is due. */
+    timer_idle_enter ();
+
     /* Re-enable interrupts and wait for the next one.
 
        The `sti' instruction disables interrupts until the
@@ -501,9 +1058,20 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->held_locks);
+  list_init (&t->joiners);
+  t->time_slice = (t != running_thread ()
+                   ? thread_current ()->time_slice : thread_time_slice);
+  if (thread_mlfqs && t != running_thread ())
+  {
+    /* New threads inherit niceness and recent CPU usage from
+       their parent. */
+    t->nice = thread_current ()->nice;
+    t->recent_cpu = thread_current ()->recent_cpu;
+    mlfqs_update_priority (t, NULL);
+  }
   t->magic = THREAD_MAGIC;
-  list_push_back (&all_list, &t->allelem);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -519,18 +1087,188 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Returns true if T is a real-time thread with budget left in
+   its current period, false otherwise. */
+  static bool
+rt_eligible (const struct thread *t)
+{
+  return t->rt_period != 0 && t->rt_used < t->rt_budget;
+}
+
+/* Appends T to the run queue for its priority, or adds it to
+   rt_queue if it is an eligible real-time thread. */
+  static void
+ready_queue_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  if (rt_eligible (t))
+  {
+    heap_push (&rt_queue, &t->rtelem);
+    t->rt_queued = true;
+    ready_cnt++;
+    return;
+  }
+
+  list_push_back (&ready_queues[t->priority - PRI_MIN], &t->elem);
+  ready_mask |= (uint64_t) 1 << (t->priority - PRI_MIN);
+  ready_cnt++;
+}
+
+/* Returns the priority of the highest-priority ready thread, or
+   PRI_MIN - 1 if no thread is ready.  Only the two 32-bit halves
+   of ready_mask are scanned, so this takes constant time. */
+  static int
+ready_queue_max_priority (void)
+{
+  uint32_t high = ready_mask >> 32;
+  uint32_t low = ready_mask;
+
+  if (high != 0)
+    return PRI_MIN + 63 - __builtin_clz (high);
+  else if (low != 0)
+    return PRI_MIN + 31 - __builtin_clz (low);
+  else
+    return PRI_MIN - 1;
+}
+
+/* Removes and returns the first thread in the highest-priority
+   non-empty run queue.  At least one thread must be ready. */
+  static struct thread *
+ready_queue_pop (void)
+{
+  int level = ready_queue_max_priority () - PRI_MIN;
+  struct list *queue;
+  struct thread *t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (level >= 0);
+
+  queue = &ready_queues[level];
+  t = list_entry (list_pop_front (queue), struct thread, elem);
+  if (list_empty (queue))
+    ready_mask &= ~((uint64_t) 1 << level);
+  ready_cnt--;
+  return t;
+}
+
+/* Removes ready thread T from its run queue. */
+  static void
+ready_queue_remove (struct thread *t)
+{
+  int level = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  if (t->rt_queued)
+  {
+    heap_remove (&rt_queue, &t->rtelem);
+    t->rt_queued = false;
+    ready_cnt--;
+    return;
+  }
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[level]))
+    ready_mask &= ~((uint64_t) 1 << level);
+  ready_cnt--;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   return a thread from the highest-priority non-empty run queue,
+   unless every run queue is empty.  (If the running thread can
+   continue running, then it will be in a run queue.)  If every
+   run queue is empty, return idle_thread. */
   static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  if (!heap_empty (&rt_queue))
+  {
+    struct thread *t = heap_entry (heap_pop (&rt_queue), struct thread,
+                                   rtelem);
+    t->rt_queued = false;
+    ready_cnt--;
+    return t;
+  }
+  else if (ready_mask == 0)
     return idle_thread;
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return ready_queue_pop ();
+}
+
+/* Returns true if some ready thread should run in preference to
+   running thread CUR: an eligible real-time thread with an
+   earlier deadline, or, if CUR is not an eligible real-time
+   thread, any eligible real-time thread or a thread of higher
+   priority. */
+  static bool
+ready_queue_has_higher (struct thread *cur)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!heap_empty (&rt_queue))
+  {
+    struct thread *t = heap_entry (heap_max (&rt_queue), struct thread,
+                                   rtelem);
+    return !rt_eligible (cur) || t->rt_deadline < cur->rt_deadline;
+  }
+  return !rt_eligible (cur) && ready_queue_max_priority () > cur->priority;
+}
+
+/* Returns true if real-time thread A's deadline is later than
+   B's, so that rt_queue yields the earliest deadline first. */
+  static bool
+rt_deadline_later (const struct heap_elem *a_, const struct heap_elem *b_,
+                   void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, rtelem);
+  const struct thread *b = heap_entry (b_, struct thread, rtelem);
+
+  return a->rt_deadline > b->rt_deadline;
+}
+
+/* Starts a new period for each real-time thread whose current
+   period ended at or before tick NOW, counting a deadline miss
+   for each whose job was not done by then. */
+  static void
+rt_start_periods (int64_t now)
+{
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&rt_threads); e != list_end (&rt_threads);
+       e = list_next (e))
+  {
+    struct thread *t = list_entry (e, struct thread, rt_allelem);
+
+    if (now < t->rt_deadline)
+      continue;
+    if (!t->rt_done)
+    {
+      t->rt_misses++;
+      rt_miss_cnt++;
+    }
+    while (t->rt_deadline <= now)
+      t->rt_deadline += t->rt_period;
+    t->rt_used = 0;
+    t->rt_done = false;
+
+    if (t->rt_waiting)
+    {
+      t->rt_waiting = false;
+      thread_unblock (t);
+    }
+    else if (t->status == THREAD_READY)
+    {
+      /* Move to rt_queue, or to its new place in it. */
+      ready_queue_remove (t);
+      ready_queue_push (t);
+    }
+  }
+  thread_yield_to_higher ();
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -562,6 +1300,10 @@ thread_schedule_tail (struct thread *prev)
   /* Start new time slice. */
   thread_ticks = 0;
 
+  /* Trap the new thread's first FPU instruction, unless the FPU
+     already holds its state. */
+  fpu_switch (cur);
+
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
@@ -575,10 +1317,55 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
   {
     ASSERT (prev != cur);
-    palloc_free_page (prev);
+    free_thread_page (prev);
   }
 }
 
+/* Returns a page for a new thread, or a null pointer if none is
+   available.  A page from the thread cache is returned as is,
+   since init_thread() clears the struct thread at its start and
+   nothing reads the rest of the page before writing it; only a
+   fresh page from the page allocator is zeroed. */
+  static struct thread *
+alloc_thread_page (void) 
+{
+  enum intr_level old_level;
+  void *page;
+
+  old_level = intr_disable ();
+  page = thread_cache;
+  if (page != NULL)
+    {
+      thread_cache = *(void **) page;
+      thread_cache_cnt--;
+      thread_cache_hits++;
+    }
+  else
+    thread_cache_misses++;
+  intr_set_level (old_level);
+
+  if (page == NULL)
+    page = palloc_get_page (PAL_ZERO);
+  return page;
+}
+
+/* Frees the page of dying thread T, keeping it in the thread
+   cache unless the cache is full. */
+  static void
+free_thread_page (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_cache_cnt < THREAD_CACHE_MAX)
+    {
+      *(void **) t = thread_cache;
+      thread_cache = t;
+      thread_cache_cnt++;
+    }
+  else
+    palloc_free_page (t);
+}
+
 /* Schedules a new process.  At entry, interrupts must be off and
    the running process's state must have been changed from
    running to some other state.  This function finds another
@@ -590,15 +1377,31 @@ thread_schedule_tail (struct thread *prev)
 schedule (void) 
 {
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct thread *next;
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
+
+  /* If the idle thread is giving up the CPU, bring the clock up
+     to date first, which may wake up sleepers. */
+  if (cur == idle_thread)
+    timer_idle_exit ();
+
+  next = next_thread_to_run ();
   ASSERT (is_thread (next));
 
   if (cur != next)
+  {
+    if (cur->status == THREAD_READY)
+      cur->involuntary_switches++;
+    else
+      cur->voluntary_switches++;
+    if (next != idle_thread)
+      next->ready_wait_ns += timer_ns () - next->ready_ns;
+    schedtrace_record (SCHED_SWITCH, cur->tid, next->tid);
     prev = switch_threads (cur, next);
+  }
   thread_schedule_tail (prev);
 }
 
@@ -2,8 +2,10 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 #include "threads/synch.h"
 #include "filesys/file.h"
 #include "filesys/fdmap.h"
@@ -28,6 +30,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the MLFQS scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice to other threads. */
+
 
 /* A kernel thread or user process.
 
@@ -80,11 +87,13 @@ typedef int tid_t;
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   the run queue (thread.c), or it can be an element in a sleep
+   list (timer.c).  It can be used these two ways only because
+   they are mutually exclusive: only a thread in the ready state
+   is on the run queue, whereas only a blocked thread is on a
+   sleep list.  A thread blocked on a semaphore is kept in the
+   semaphore's waiter heap (synch.c) through `waitelem'
+   instead. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -92,14 +101,54 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donation. */
+    int nice;                           /* MLFQS niceness. */
+    fixed_point recent_cpu;             /* MLFQS recent CPU usage. */
+    unsigned time_slice;                /* Timer ticks per time slice. */
     struct list_elem allelem;           /* List element for all threads list. */
-
-    /* Shared between thread.c and synch.c. */
+    struct hash_elem tidelem;           /* Element in tid table. */
+    struct list joiners;                /* Threads in thread_join(). */
+
+    /* CPU accounting, owned by thread.c. */
+    int64_t user_ticks;                 /* Timer ticks in user mode. */
+    int64_t kernel_ticks;               /* Timer ticks in kernel mode. */
+    unsigned voluntary_switches;        /* Switches away while blocking. */
+    unsigned involuntary_switches;      /* Switches away while runnable. */
+    int64_t ready_ns;                   /* timer_ns() when made ready. */
+    int64_t ready_wait_ns;              /* Total time spent ready. */
+
+    /* Shared between thread.c and timer.c. */
     struct list_elem elem;              /* List element. */
 
     struct list_elem childelem;         /* List element for child list */
 
+    /* Owned by synch.c. */
+    struct heap_elem waitelem;          /* Semaphore waiter heap element. */
+    unsigned wait_seq;                  /* Arrival order among waiters. */
+    struct semaphore *waiting_sema;     /* Semaphore being waited for. */
+    struct list held_locks;             /* Locks held, for donation. */
+    struct lock *waiting_lock;          /* Lock being waited for. */
+
+    /* EDF real-time class, owned by thread.c. */
+    int rt_period;                      /* Period in ticks, 0 if not RT. */
+    int rt_budget;                      /* Ticks of CPU per period. */
+    int64_t rt_deadline;                /* End of the current period. */
+    int rt_used;                        /* Ticks used this period. */
+    bool rt_done;                       /* Job for this period complete? */
+    bool rt_waiting;                    /* In thread_rt_wait_period()? */
+    bool rt_queued;                     /* In rt_queue? */
+    unsigned rt_misses;                 /* # of deadlines missed. */
+    struct heap_elem rtelem;            /* Element in rt_queue. */
+    struct list_elem rt_allelem;        /* Element in rt_threads. */
+
+    /* Owned by threads/fpu.c. */
+    uint8_t *fpu_area;                  /* FPU save area, if allocated. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick at which to wake up. */
+    int64_t wakeup_ns;                  /* timer_ns() at which to wake up. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
@@ -123,10 +172,18 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* Time slice, in timer ticks, of the initial thread.  Other
+   threads inherit the time slice of the thread that created
+   them, which may change it with thread_set_time_slice().
+   Controlled by kernel command-line option "-slice=TICKS". */
+#define TIME_SLICE_DEFAULT 4
+extern unsigned thread_time_slice;
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_skip_idle_ticks (int64_t);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -140,7 +197,9 @@ tid_t thread_tid (void);
 const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
+void thread_join (tid_t);
 void thread_yield (void);
+void thread_yield_to_higher (void);
 
 struct thread* get_thread(tid_t tid);
 
@@ -150,9 +209,23 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int);
+void thread_refresh_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
+unsigned thread_get_time_slice (void);
+void thread_set_time_slice (unsigned);
+
+/* Maximum total utilization of all real-time threads, in
+   thousandths of the CPU.  The rest is left to the other
+   threads. */
+#define RT_UTIL_MAX 900
+
+bool thread_set_realtime (int period, int budget);
+void thread_clear_realtime (void);
+void thread_rt_wait_period (void);
+int64_t thread_rt_next_deadline (void);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
@@ -0,0 +1,193 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+
+/* Work queues.  Short-lived kernel work, such as flushing or
+   prefetching a block, is cheaper to hand to a worker thread
+   that is already running than to give a thread of its own.
+
+   A work queue holds at most CAPACITY items that have not yet
+   been started.  Submitting to a full queue waits for a worker
+   to take an item, so that a producer that outruns the workers
+   is slowed down to their pace instead of queuing without
+   bound.  workqueue_submit_batch() adds many items for the cost
+   of one lock acquisition and one wakeup of the workers. */
+
+static thread_func worker;
+
+/* Initializes WORK to call FUNC with AUX. */
+void
+work_init (struct work *work, work_func *func, void *aux)
+{
+  ASSERT (work != NULL);
+  ASSERT (func != NULL);
+
+  work->func = func;
+  work->aux = aux;
+}
+
+/* Initializes WQ as a work queue named NAME that holds up to
+   CAPACITY pending items and starts WORKER_CNT worker threads
+   for it at the given PRIORITY.  Returns true if successful.  On
+   failure, any workers already started are stopped again. */
+bool
+workqueue_init (struct workqueue *wq, const char *name, int worker_cnt,
+                int priority, size_t capacity)
+{
+  ASSERT (wq != NULL);
+  ASSERT (name != NULL);
+  ASSERT (worker_cnt > 0 && worker_cnt <= WORKQUEUE_MAX_WORKERS);
+  ASSERT (capacity > 0);
+
+  wq->name = name;
+  lock_init (&wq->lock);
+  list_init (&wq->queue);
+  wq->queued = 0;
+  wq->capacity = capacity;
+  wq->busy = 0;
+  wq->stopping = false;
+  cond_init (&wq->not_empty);
+  cond_init (&wq->not_full);
+  cond_init (&wq->idle);
+  wq->completed_cnt = 0;
+
+  for (wq->worker_cnt = 0; wq->worker_cnt < worker_cnt; wq->worker_cnt++)
+    {
+      tid_t tid = thread_create (name, priority, worker, wq);
+      if (tid == TID_ERROR)
+        {
+          workqueue_destroy (wq);
+          return false;
+        }
+      wq->workers[wq->worker_cnt] = tid;
+    }
+  return true;
+}
+
+/* Adds WORK to WQ, waiting for room if WQ is full. */
+void
+workqueue_submit (struct workqueue *wq, struct work *work)
+{
+  workqueue_submit_batch (wq, &work, 1);
+}
+
+/* Adds WORK to WQ and returns true if WQ has room for it.
+   Otherwise, returns false without waiting. */
+bool
+workqueue_try_submit (struct workqueue *wq, struct work *work)
+{
+  bool success;
+
+  ASSERT (wq != NULL);
+  ASSERT (work != NULL);
+
+  lock_acquire (&wq->lock);
+  ASSERT (!wq->stopping);
+  success = wq->queued < wq->capacity;
+  if (success)
+    {
+      list_push_back (&wq->queue, &work->elem);
+      wq->queued++;
+      cond_signal (&wq->not_empty, &wq->lock);
+    }
+  lock_release (&wq->lock);
+  return success;
+}
+
+/* Adds the CNT items in WORKS to WQ, in order, waiting for room
+   as necessary. */
+void
+workqueue_submit_batch (struct workqueue *wq, struct work *works[],
+                        size_t cnt)
+{
+  size_t i;
+
+  ASSERT (wq != NULL);
+  ASSERT (works != NULL || cnt == 0);
+
+  lock_acquire (&wq->lock);
+  ASSERT (!wq->stopping);
+  for (i = 0; i < cnt; i++)
+    {
+      if (wq->queued >= wq->capacity)
+        {
+          /* Let the workers at what we have queued so far before
+             we wait for them to make room. */
+          cond_broadcast (&wq->not_empty, &wq->lock);
+          while (wq->queued >= wq->capacity)
+            cond_wait (&wq->not_full, &wq->lock);
+        }
+      list_push_back (&wq->queue, &works[i]->elem);
+      wq->queued++;
+    }
+  if (cnt == 1)
+    cond_signal (&wq->not_empty, &wq->lock);
+  else if (cnt > 1)
+    cond_broadcast (&wq->not_empty, &wq->lock);
+  lock_release (&wq->lock);
+}
+
+/* Waits until all of the work submitted to WQ has been run. */
+void
+workqueue_flush (struct workqueue *wq)
+{
+  ASSERT (wq != NULL);
+
+  lock_acquire (&wq->lock);
+  while (wq->queued > 0 || wq->busy > 0)
+    cond_wait (&wq->idle, &wq->lock);
+  lock_release (&wq->lock);
+}
+
+/* Runs the work already submitted to WQ, then stops WQ's worker
+   threads and waits for them to exit.  No work may be submitted
+   to WQ afterward. */
+void
+workqueue_destroy (struct workqueue *wq)
+{
+  int i;
+
+  ASSERT (wq != NULL);
+
+  lock_acquire (&wq->lock);
+  wq->stopping = true;
+  cond_broadcast (&wq->not_empty, &wq->lock);
+  lock_release (&wq->lock);
+
+  for (i = 0; i < wq->worker_cnt; i++)
+    thread_join (wq->workers[i]);
+  wq->worker_cnt = 0;
+}
+
+/* Worker thread for the work queue passed as WQ_.  Runs work
+   until the queue is empty and being destroyed. */
+static void
+worker (void *wq_)
+{
+  struct workqueue *wq = wq_;
+
+  lock_acquire (&wq->lock);
+  for (;;)
+    {
+      struct work *work;
+
+      while (list_empty (&wq->queue) && !wq->stopping)
+        cond_wait (&wq->not_empty, &wq->lock);
+      if (list_empty (&wq->queue))
+        break;
+
+      work = list_entry (list_pop_front (&wq->queue), struct work, elem);
+      wq->queued--;
+      wq->busy++;
+      cond_signal (&wq->not_full, &wq->lock);
+      lock_release (&wq->lock);
+
+      work->func (work->aux);
+
+      lock_acquire (&wq->lock);
+      wq->busy--;
+      wq->completed_cnt++;
+      if (wq->queued == 0 && wq->busy == 0)
+        cond_broadcast (&wq->idle, &wq->lock);
+    }
+  lock_release (&wq->lock);
+}
@@ -0,0 +1,54 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* A unit of work: FUNC is called with AUX by one of a work
+   queue's worker threads.  The submitter owns the struct work
+   and must not reuse or free it until FUNC has started. */
+typedef void work_func (void *aux);
+struct work
+  {
+    struct list_elem elem;      /* Element in work queue. */
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Argument for FUNC. */
+  };
+
+void work_init (struct work *, work_func *, void *aux);
+
+/* Maximum number of worker threads per work queue. */
+#define WORKQUEUE_MAX_WORKERS 8
+
+/* A bounded queue of work served by a fixed set of worker
+   threads. */
+struct workqueue
+  {
+    const char *name;           /* Name, also used for the workers. */
+    struct lock lock;           /* Protects the members below. */
+    struct list queue;          /* Work not yet started. */
+    size_t queued;              /* Number of items in QUEUE. */
+    size_t capacity;            /* Maximum number of items in QUEUE. */
+    size_t busy;                /* Number of items being run. */
+    bool stopping;              /* Set by workqueue_destroy(). */
+    struct condition not_empty; /* Signaled when QUEUE gains work. */
+    struct condition not_full;  /* Signaled when QUEUE loses work. */
+    struct condition idle;      /* Signaled when QUEUE drains and no
+                                   work is running. */
+    tid_t workers[WORKQUEUE_MAX_WORKERS]; /* Worker threads. */
+    int worker_cnt;             /* Number of worker threads. */
+    unsigned long long completed_cnt; /* Number of items run. */
+  };
+
+bool workqueue_init (struct workqueue *, const char *name, int worker_cnt,
+                     int priority, size_t capacity);
+void workqueue_submit (struct workqueue *, struct work *);
+bool workqueue_try_submit (struct workqueue *, struct work *);
+void workqueue_submit_batch (struct workqueue *, struct work *[], size_t cnt);
+void workqueue_flush (struct workqueue *);
+void workqueue_destroy (struct workqueue *);
+
+#endif /* threads/workqueue.h */
@@ -6,6 +6,7 @@
 #include <list.h>
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
 #include "devices/shutdown.h"
@@ -22,6 +23,9 @@
 
 struct lock *filelock = NULL;
 
+/* Allocates struct fdmap for open file descriptors. */
+static struct slab_cache fdmap_cache;
+
 static void syscall_handler (struct intr_frame *);
 
 struct file * get_file(int _fd)
@@ -52,10 +56,11 @@ void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  slab_cache_init (&fdmap_cache, "fdmap", sizeof (struct fdmap), NULL);
   if(filelock == NULL)
   {
     filelock = (struct lock *)malloc(sizeof(struct lock));
-    lock_init(filelock);
+    lock_init_named(filelock, "filelock");
   }
 }
 
@@ -200,7 +205,7 @@ void exit (int status)
     list_remove(e);
     e = list_begin(&cur->fd_mapping_list);
     file_close(map->fp);/////////////////////////////////////////
-    free(map);
+    slab_free(&fdmap_cache, map);
     if(!list_size(&cur->fd_mapping_list))
       break;
   }
@@ -290,14 +295,14 @@ int open (const char *file)
   // printf("breakbreakbreak\n");
   //map the file 
   struct fdmap * mapping = 
-    (struct fdmap *)malloc(sizeof(struct fdmap));
+    (struct fdmap *)slab_alloc(&fdmap_cache);
   mapping->fd = _fd;
   lock_acquire(filelock);
   mapping->fp = filesys_open(file);
   lock_release(filelock);
   if(!mapping->fp)
   {
-    free(mapping);
+    slab_free(&fdmap_cache, mapping);
     return -1;
   }
 
@@ -372,7 +377,7 @@ void close (int _fd)
     if(map->fd == _fd)
     {
       list_remove(e);
-      free(map);
+      slab_free(&fdmap_cache, map);
       break;
     }
   }